@@ -0,0 +1,353 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Micro-benchmark of webrtcaudioprocessor and webrtcaudioprobe.
+ *
+ * Drives a probe and a processor paired with it through appsrc/appsink,
+ * one 10ms period at a time, for every combination of rate, channel count
+ * and echo-cancel/noise-suppression/gain-controller. For each one it
+ * reports the wall time per period, the GstMemory allocations per period
+ * and the p50/p99/p999 latency between pushing a capture buffer and
+ * receiving it processed.
+ *
+ * Build the plugin with -Dengine=stub for results that do not depend on
+ * the webrtc library. */
+
+#include <stdio.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <gst/audio/audio.h>
+
+/* Counts every allocation going through the default allocator */
+
+typedef struct _BenchAllocator BenchAllocator;
+typedef struct _BenchAllocatorClass BenchAllocatorClass;
+
+struct _BenchAllocator
+{
+  GstAllocator parent;
+  GstAllocator *sysmem;
+};
+
+struct _BenchAllocatorClass
+{
+  GstAllocatorClass parent_class;
+};
+
+GType bench_allocator_get_type (void);
+G_DEFINE_TYPE (BenchAllocator, bench_allocator, GST_TYPE_ALLOCATOR);
+
+static gint bench_allocations = 0;
+
+static GstMemory *
+bench_allocator_alloc (GstAllocator * allocator, gsize size,
+    GstAllocationParams * params)
+{
+  BenchAllocator *self = (BenchAllocator *) allocator;
+
+  g_atomic_int_inc (&bench_allocations);
+
+  /* The memory belongs to sysmem, which also frees it */
+  return gst_allocator_alloc (self->sysmem, size, params);
+}
+
+static void
+bench_allocator_init (BenchAllocator * self)
+{
+  self->sysmem = gst_allocator_find (GST_ALLOCATOR_SYSMEM);
+}
+
+static void
+bench_allocator_class_init (BenchAllocatorClass * klass)
+{
+  GST_ALLOCATOR_CLASS (klass)->alloc = bench_allocator_alloc;
+}
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  guint received;
+  std::vector<GstClockTime> *arrivals;
+} BenchSink;
+
+static GstFlowReturn
+bench_new_sample (GstAppSink * appsink, gpointer user_data)
+{
+  BenchSink *sink = (BenchSink *) user_data;
+  GstSample *sample = gst_app_sink_pull_sample (appsink);
+  GstClockTime now = gst_util_get_timestamp ();
+
+  gst_sample_unref (sample);
+
+  g_mutex_lock (&sink->lock);
+  if (sink->arrivals)
+    sink->arrivals->push_back (now);
+  sink->received++;
+  g_cond_signal (&sink->cond);
+  g_mutex_unlock (&sink->lock);
+
+  return GST_FLOW_OK;
+}
+
+static void
+bench_wait (BenchSink * sink, guint count)
+{
+  g_mutex_lock (&sink->lock);
+  while (sink->received < count)
+    g_cond_wait (&sink->cond, &sink->lock);
+  g_mutex_unlock (&sink->lock);
+}
+
+static void
+bench_sink_init (BenchSink * sink, GstElement * appsink,
+    std::vector<GstClockTime> * arrivals)
+{
+  GstAppSinkCallbacks callbacks = { NULL, NULL, bench_new_sample };
+
+  g_mutex_init (&sink->lock);
+  g_cond_init (&sink->cond);
+  sink->received = 0;
+  sink->arrivals = arrivals;
+
+  gst_app_sink_set_callbacks (GST_APP_SINK (appsink), &callbacks, sink, NULL);
+}
+
+static void
+bench_sink_clear (BenchSink * sink)
+{
+  g_mutex_clear (&sink->lock);
+  g_cond_clear (&sink->cond);
+}
+
+/* Speech-like enough for the engine: a few partials plus some noise */
+static GstBuffer *
+bench_make_buffer (const GstAudioInfo * info, guint index, gdouble freq)
+{
+  guint samples = info->rate / 100;
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, samples * info->bpf, NULL);
+  GstAudioBuffer abuf;
+  guint i, c;
+
+  gst_audio_buffer_map (&abuf, info, buffer, GST_MAP_WRITE);
+
+  for (i = 0; i < samples; i++) {
+    gdouble t = (gdouble) (index * samples + i) / info->rate;
+    gdouble v = 0.3 * sin (2 * G_PI * freq * t) + 0.1 * sin (2 * G_PI * 3 * freq * t)
+        + 0.01 * g_random_double_range (-1, 1);
+
+    for (c = 0; c < (guint) info->channels; c++) {
+      if (GST_AUDIO_INFO_LAYOUT (info) == GST_AUDIO_LAYOUT_INTERLEAVED)
+        ((gint16 *) abuf.planes[0])[i * info->channels + c] = (gint16) (v * 32767);
+      else
+        ((gfloat *) abuf.planes[c])[i] = (gfloat) v;
+    }
+  }
+
+  gst_audio_buffer_unmap (&abuf);
+
+  GST_BUFFER_PTS (buffer) = gst_util_uint64_scale_int (index, GST_SECOND, 100);
+  GST_BUFFER_DURATION (buffer) = GST_SECOND / 100;
+
+  return buffer;
+}
+
+static GstClockTime
+bench_percentile (std::vector<GstClockTime> & values, gdouble p)
+{
+  gsize index = (gsize) (p * (values.size () - 1));
+
+  std::nth_element (values.begin (), values.begin () + index, values.end ());
+
+  return values[index];
+}
+
+static gboolean
+bench_run (gint rate, gint channels, gboolean planar, gboolean aec,
+    gboolean ns, gboolean agc, guint periods)
+{
+  GstAudioInfo info;
+  GstElement *pipeline, *src, *rsrc, *sink, *rsink;
+  GstCaps *caps;
+  gchar *description;
+  GError *error = NULL;
+  BenchSink bsink, brsink;
+  std::vector<GstBuffer *> capture, reverse;
+  std::vector<GstClockTime> pushes, arrivals, latencies;
+  GstClockTime start, elapsed;
+  gint allocations;
+  guint i;
+
+  gst_audio_info_set_format (&info, planar ? GST_AUDIO_FORMAT_F32 :
+      GST_AUDIO_FORMAT_S16, rate, channels, NULL);
+  if (planar)
+    info.layout = GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+  caps = gst_audio_info_to_caps (&info);
+
+  description = g_strdup_printf (
+      "appsrc name=rsrc format=time ! webrtcaudioprobe name=probe ! "
+      "appsink name=rsink sync=false "
+      "appsrc name=src format=time ! webrtcaudioprocessor probe=probe "
+      "echo-cancel=%d noise-suppression=%d gain-controller=%d ! "
+      "appsink name=sink sync=false", aec, ns, agc);
+  pipeline = gst_parse_launch (description, &error);
+  g_free (description);
+
+  if (!pipeline) {
+    g_printerr ("Could not create pipeline: %s\n", error->message);
+    g_clear_error (&error);
+    gst_caps_unref (caps);
+    return FALSE;
+  }
+
+  src = gst_bin_get_by_name (GST_BIN (pipeline), "src");
+  rsrc = gst_bin_get_by_name (GST_BIN (pipeline), "rsrc");
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  rsink = gst_bin_get_by_name (GST_BIN (pipeline), "rsink");
+
+  g_object_set (src, "caps", caps, NULL);
+  g_object_set (rsrc, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  bench_sink_init (&bsink, sink, &arrivals);
+  bench_sink_init (&brsink, rsink, NULL);
+
+  /* Input is prepared up front so it does not count as allocations */
+  for (i = 0; i < periods; i++) {
+    capture.push_back (bench_make_buffer (&info, i, 220));
+    reverse.push_back (bench_make_buffer (&info, i, 440));
+  }
+
+  arrivals.reserve (periods);
+  pushes.reserve (periods);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+  g_atomic_int_set (&bench_allocations, 0);
+  start = gst_util_get_timestamp ();
+
+  for (i = 0; i < periods; i++) {
+    gst_app_src_push_buffer (GST_APP_SRC (rsrc), reverse[i]);
+    bench_wait (&brsink, i + 1);
+
+    pushes.push_back (gst_util_get_timestamp ());
+    gst_app_src_push_buffer (GST_APP_SRC (src), capture[i]);
+    bench_wait (&bsink, i + 1);
+  }
+
+  elapsed = gst_util_get_timestamp () - start;
+  allocations = g_atomic_int_get (&bench_allocations);
+
+  for (i = 0; i < periods; i++)
+    latencies.push_back (arrivals[i] - pushes[i]);
+
+  g_print ("%6d %2d %-6s %3d %2d %3d %10.0f %8.2f %9.1f %9.1f %9.1f\n",
+      rate, channels, planar ? "f32" : "s16", aec, ns, agc,
+      (gdouble) elapsed / periods, (gdouble) allocations / periods,
+      bench_percentile (latencies, 0.5) / 1000.0,
+      bench_percentile (latencies, 0.99) / 1000.0,
+      bench_percentile (latencies, 0.999) / 1000.0);
+
+  gst_app_src_end_of_stream (GST_APP_SRC (src));
+  gst_app_src_end_of_stream (GST_APP_SRC (rsrc));
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  bench_sink_clear (&bsink);
+  bench_sink_clear (&brsink);
+  gst_object_unref (src);
+  gst_object_unref (rsrc);
+  gst_object_unref (sink);
+  gst_object_unref (rsink);
+  gst_object_unref (pipeline);
+
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const gint rates[] = { 8000, 16000, 32000, 48000 };
+  gchar *plugin_path = NULL;
+  gint max_channels = 8;
+  gint periods = 1000;
+  gboolean planar = FALSE;
+  GOptionEntry entries[] = {
+    {"plugin", 0, 0, G_OPTION_ARG_FILENAME, &plugin_path,
+        "Path of the webrtcaudioprocessing plugin to load", "PATH"},
+    {"max-channels", 0, 0, G_OPTION_ARG_INT, &max_channels,
+        "Benchmark 1 to this many channels (default 8)", "N"},
+    {"periods", 0, 0, G_OPTION_ARG_INT, &periods,
+        "Number of 10ms periods pushed per combination (default 1000)", "N"},
+    {"planar", 0, 0, G_OPTION_ARG_NONE, &planar,
+        "Use non-interleaved F32 instead of interleaved S16", NULL},
+    {NULL}
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  guint r;
+  gint channels, features;
+
+  context = g_option_context_new ("- webrtcaudioprocessing micro-benchmark");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  gst_init (&argc, &argv);
+
+  if (plugin_path) {
+    GstPlugin *plugin = gst_plugin_load_file (plugin_path, &error);
+
+    if (!plugin) {
+      g_printerr ("Could not load %s: %s\n", plugin_path, error->message);
+      return 1;
+    }
+    gst_object_unref (plugin);
+  }
+
+  gst_allocator_set_default (GST_ALLOCATOR (g_object_new (bench_allocator_get_type (), NULL)));
+
+  g_print ("%6s %2s %-6s %3s %2s %3s %10s %8s %9s %9s %9s\n", "rate", "ch",
+      "format", "aec", "ns", "agc", "ns/period", "allocs", "p50(us)",
+      "p99(us)", "p999(us)");
+
+  for (r = 0; r < G_N_ELEMENTS (rates); r++)
+    for (channels = 1; channels <= max_channels; channels++)
+      for (features = 0; features < 8; features++)
+        if (!bench_run (rates[r], channels, planar, features & 1,
+                (features >> 1) & 1, (features >> 2) & 1, periods))
+          return 1;
+
+  g_free (plugin_path);
+
+  return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Pass-through implementation of the ap_* entry points, selected with
+ * -Dengine=stub. Audio is left untouched, so the plugin can be built, run
+ * and benchmarked without the webrtc library.
+ *
+ * Every processed sample costs a fixed number of multiply-adds, set at
+ * build time with -Dstub_cost and overridden at run time with the
+ * AP_STUB_COST environment variable. The work depends only on the amount
+ * of audio, so profiles are reproducible from run to run.
+ *
+ * Each engine records the delays it receives. When AP_STUB_LOG is set,
+ * every change is reported on stderr, and a summary when it is deleted.
+ *
+ * Voice activity is a plain energy threshold, enough to exercise the
+ * elements' voice detection on synthetic and real input. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "webrtc.h"
+
+#ifndef AP_STUB_COST
+#define AP_STUB_COST 0
+#endif
+
+/* Mean square of a period above which it counts as voice, about -60 dBFS */
+#define VOICE_THRESHOLD 1e-6f
+
+struct ap_engine
+{
+  int rate;
+  bool echo_cancel;
+  bool noise_suppression;
+  int noise_suppression_level;
+  bool gain_controller;
+  int delay;
+  /* Delay bookkeeping */
+  long delay_calls;
+  long delay_changes;
+  int delay_min;
+  int delay_max;
+  /* Voice activity of the last capture call */
+  bool voice_detection;
+  int voice_activity;
+  /* Synthetic load */
+  unsigned cost;
+  bool log;
+  volatile float sink;
+};
+
+static void
+burn(ap_engine *engine, float sample)
+{
+  float acc = sample;
+  unsigned i;
+
+  for (i = 0; i < engine->cost; i++)
+    acc = acc * 0.999f + 0.001f;
+
+  engine->sink = acc;
+}
+
+static void
+burn_s16(ap_engine *engine, int rate, int channels, const int16_t *data)
+{
+  int i, samples = rate / 100 * channels;
+
+  if (!engine->cost)
+    return;
+
+  for (i = 0; i < samples; i++)
+    burn(engine, data[i]);
+}
+
+static void
+burn_float(ap_engine *engine, int rate, int channels, float* const* data)
+{
+  int i, c, samples = rate / 100;
+
+  if (!engine->cost)
+    return;
+
+  for (c = 0; c < channels; c++)
+    for (i = 0; i < samples; i++)
+      burn(engine, data[c][i]);
+}
+
+static bool
+has_voice_s16(int rate, int channels, const int16_t *data)
+{
+  int i, samples = rate / 100 * channels;
+  float energy = 0.0f;
+
+  for (i = 0; i < samples; i++)
+    energy += (float) data[i] * data[i];
+
+  return energy / (32768.0f * 32768.0f) > VOICE_THRESHOLD * samples;
+}
+
+static bool
+has_voice_float(int rate, int channels, float* const* data)
+{
+  int i, c, samples = rate / 100;
+  float energy = 0.0f;
+
+  for (c = 0; c < channels; c++)
+    for (i = 0; i < samples; i++)
+      energy += data[c][i] * data[c][i];
+
+  return energy > VOICE_THRESHOLD * samples * channels;
+}
+
+ap_engine*
+ap_setup(int rate, bool echo_cancel, bool noise_suppression,
+    int noise_suppression_level, bool gain_controller, int logging_severity)
+{
+  ap_engine *engine = new ap_engine ();
+  const char *cost = getenv("AP_STUB_COST");
+
+  (void) logging_severity;
+
+  engine->cost = cost ? (unsigned) strtoul(cost, NULL, 10) : AP_STUB_COST;
+  engine->log = getenv("AP_STUB_LOG") != NULL;
+
+  engine->rate = rate;
+  engine->echo_cancel = echo_cancel;
+  engine->noise_suppression = noise_suppression;
+  engine->noise_suppression_level = noise_suppression_level;
+  engine->gain_controller = gain_controller;
+
+  return engine;
+}
+
+void
+ap_delete(ap_engine *engine)
+{
+  if (engine->log)
+    fprintf(stderr, "ap_stub %p: %ld delay calls, %ld changes, "
+        "last %d ms, range %d-%d ms\n", (void *) engine, engine->delay_calls,
+        engine->delay_changes, engine->delay, engine->delay_min,
+        engine->delay_max);
+
+  delete engine;
+}
+
+const char*
+ap_error(ap_engine *engine, int err)
+{
+  (void) engine;
+
+  return err < 0 ? "stub engine error" : "no error";
+}
+
+void
+ap_delay(ap_engine *engine, int delay)
+{
+  if (!engine->delay_calls || delay != engine->delay) {
+    if (engine->log)
+      fprintf(stderr, "ap_stub %p: delay %d ms\n", (void *) engine, delay);
+    engine->delay_changes++;
+  }
+
+  if (!engine->delay_calls || delay < engine->delay_min)
+    engine->delay_min = delay;
+  if (!engine->delay_calls || delay > engine->delay_max)
+    engine->delay_max = delay;
+
+  engine->delay = delay;
+  engine->delay_calls++;
+}
+
+void
+ap_configure(ap_engine *engine, bool echo_cancel, bool noise_suppression,
+    int noise_suppression_level, bool gain_controller)
+{
+  engine->echo_cancel = echo_cancel;
+  engine->noise_suppression = noise_suppression;
+  engine->noise_suppression_level = noise_suppression_level;
+  engine->gain_controller = gain_controller;
+}
+
+int
+ap_process_reverse(ap_engine *engine, int rate, int channels, int16_t *data)
+{
+  burn_s16(engine, rate, channels, data);
+
+  return 0;
+}
+
+int
+ap_process(ap_engine *engine, int rate, int channels, int16_t *data)
+{
+  burn_s16(engine, rate, channels, data);
+
+  if (engine->voice_detection)
+    engine->voice_activity = has_voice_s16(rate, channels, data);
+
+  return 0;
+}
+
+int
+ap_process_reverse_float(ap_engine *engine, int rate, int channels,
+    float* const* data)
+{
+  burn_float(engine, rate, channels, data);
+
+  return 0;
+}
+
+int
+ap_process_float(ap_engine *engine, int rate, int channels, float* const* data)
+{
+  burn_float(engine, rate, channels, data);
+
+  if (engine->voice_detection)
+    engine->voice_activity = has_voice_float(rate, channels, data);
+
+  return 0;
+}
+
+int
+ap_process_reverse_float_batch(ap_engine *engine, int rate, int channels,
+    int periods, float* const* data)
+{
+  int p;
+
+  for (p = 0; p < periods; p++)
+    burn_float(engine, rate, channels, data + p * channels);
+
+  return 0;
+}
+
+int
+ap_process_float_batch(ap_engine *engine, int rate, int channels,
+    int periods, float* const* data)
+{
+  int p;
+
+  engine->voice_activity = 0;
+
+  for (p = 0; p < periods; p++) {
+    burn_float(engine, rate, channels, data + p * channels);
+
+    if (engine->voice_detection &&
+        has_voice_float(rate, channels, data + p * channels))
+      engine->voice_activity |= 1 << p;
+  }
+
+  return 0;
+}
+
+void
+ap_voice_detection(ap_engine *engine, bool enable)
+{
+  engine->voice_detection = enable;
+  engine->voice_activity = 0;
+}
+
+int
+ap_voice_activity(ap_engine *engine)
+{
+  return engine->voice_activity;
+}
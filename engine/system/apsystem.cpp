@@ -0,0 +1,273 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Implementation of the ap_* entry points over the distribution's
+ * webrtc-audio-processing-1 library, selected with -Dengine=system.
+ *
+ * It is linked statically into the plugin and built with LTO, so the
+ * wrappers below vanish into their callers. */
+
+#include <modules/audio_processing/include/audio_processing.h>
+
+#include "webrtc.h"
+
+struct ap_engine
+{
+  rtc::scoped_refptr<webrtc::AudioProcessing> apm;
+  webrtc::AudioProcessing::Config config;
+  int processing_rate;
+  int delay;
+  int voice_activity;
+};
+
+static webrtc::AudioProcessing::Config::NoiseSuppression::Level
+noise_suppression_level(int level)
+{
+  typedef webrtc::AudioProcessing::Config::NoiseSuppression NS;
+
+  switch (level) {
+    case NSL_LOW:
+      return NS::kLow;
+    case NSL_HIGH:
+      return NS::kHigh;
+    case NSL_VERYHIGH:
+      return NS::kVeryHigh;
+    default:
+      return NS::kModerate;
+  }
+}
+
+static void
+apply_config(ap_engine *engine, bool echo_cancel, bool noise_suppression,
+    int noise_suppression_level_, bool gain_controller)
+{
+  webrtc::AudioProcessing::Config &config = engine->config;
+
+  config.echo_canceller.enabled = echo_cancel;
+  config.echo_canceller.mobile_mode = false;
+  config.noise_suppression.enabled = noise_suppression;
+  config.noise_suppression.level =
+      noise_suppression_level(noise_suppression_level_);
+  config.gain_controller1.enabled = gain_controller;
+  config.gain_controller1.mode =
+      webrtc::AudioProcessing::Config::GainController1::kAdaptiveDigital;
+  config.high_pass_filter.enabled = echo_cancel || noise_suppression;
+  config.pipeline.maximum_internal_processing_rate = engine->processing_rate;
+
+  engine->apm->ApplyConfig(config);
+}
+
+ap_engine*
+ap_setup(int rate, bool echo_cancel, bool noise_suppression,
+    int noise_suppression_level, bool gain_controller, int logging_severity)
+{
+  ap_engine *engine;
+
+  /* The distribution library does not export its logging controls */
+  (void) logging_severity;
+
+  engine = new ap_engine ();
+  /* The highest rate the engine processes at internally, the stream rate
+   * is given on every call */
+  engine->processing_rate = rate;
+  engine->apm = webrtc::AudioProcessingBuilder().Create();
+  if (!engine->apm) {
+    delete engine;
+    return NULL;
+  }
+
+  apply_config(engine, echo_cancel, noise_suppression,
+      noise_suppression_level, gain_controller);
+
+  return engine;
+}
+
+void
+ap_delete(ap_engine *engine)
+{
+  delete engine;
+}
+
+const char*
+ap_error(ap_engine *engine, int err)
+{
+  (void) engine;
+
+  switch (err) {
+    case webrtc::AudioProcessing::kNoError:
+      return "no error";
+    case webrtc::AudioProcessing::kCreationFailedError:
+      return "creation failed";
+    case webrtc::AudioProcessing::kUnsupportedComponentError:
+      return "unsupported component";
+    case webrtc::AudioProcessing::kUnsupportedFunctionError:
+      return "unsupported function";
+    case webrtc::AudioProcessing::kNullPointerError:
+      return "null pointer";
+    case webrtc::AudioProcessing::kBadParameterError:
+      return "bad parameter";
+    case webrtc::AudioProcessing::kBadSampleRateError:
+      return "bad sample rate";
+    case webrtc::AudioProcessing::kBadDataLengthError:
+      return "bad data length";
+    case webrtc::AudioProcessing::kBadNumberChannelsError:
+      return "bad number of channels";
+    case webrtc::AudioProcessing::kFileError:
+      return "file error";
+    case webrtc::AudioProcessing::kStreamParameterNotSetError:
+      return "stream parameter not set";
+    case webrtc::AudioProcessing::kNotEnabledError:
+      return "not enabled";
+    case webrtc::AudioProcessing::kBadStreamParameterWarning:
+      return "bad stream parameter";
+    default:
+      return "unspecified error";
+  }
+}
+
+void
+ap_delay(ap_engine *engine, int delay)
+{
+  engine->delay = delay;
+}
+
+void
+ap_configure(ap_engine *engine, bool echo_cancel, bool noise_suppression,
+    int noise_suppression_level, bool gain_controller)
+{
+  apply_config(engine, echo_cancel, noise_suppression,
+      noise_suppression_level, gain_controller);
+}
+
+/* Whether the capture frame just processed had voice */
+static bool
+has_voice(ap_engine *engine)
+{
+  if (!engine->config.voice_detection.enabled)
+    return false;
+
+  return engine->apm->GetStatistics().voice_detected.value_or(false);
+}
+
+int
+ap_process_reverse(ap_engine *engine, int rate, int channels, int16_t *data)
+{
+  webrtc::StreamConfig config(rate, channels);
+
+  return engine->apm->ProcessReverseStream(data, config, config, data);
+}
+
+int
+ap_process(ap_engine *engine, int rate, int channels, int16_t *data)
+{
+  webrtc::StreamConfig config(rate, channels);
+
+  int err;
+
+  /* The library wants the delay before every capture frame */
+  engine->apm->set_stream_delay_ms(engine->delay);
+
+  err = engine->apm->ProcessStream(data, config, config, data);
+  engine->voice_activity = has_voice(engine);
+
+  return err;
+}
+
+int
+ap_process_reverse_float(ap_engine *engine, int rate, int channels,
+    float* const* data)
+{
+  webrtc::StreamConfig config(rate, channels);
+
+  return engine->apm->ProcessReverseStream(data, config, config, data);
+}
+
+int
+ap_process_float(ap_engine *engine, int rate, int channels, float* const* data)
+{
+  webrtc::StreamConfig config(rate, channels);
+  int err;
+
+  engine->apm->set_stream_delay_ms(engine->delay);
+
+  err = engine->apm->ProcessStream(data, config, config, data);
+  engine->voice_activity = has_voice(engine);
+
+  return err;
+}
+
+int
+ap_process_reverse_float_batch(ap_engine *engine, int rate, int channels,
+    int periods, float* const* data)
+{
+  webrtc::StreamConfig config(rate, channels);
+  int p, err;
+
+  for (p = 0; p < periods; p++) {
+    float* const* planes = data + p * channels;
+
+    err = engine->apm->ProcessReverseStream(planes, config, config, planes);
+    if (err < 0)
+      return err;
+  }
+
+  return 0;
+}
+
+int
+ap_process_float_batch(ap_engine *engine, int rate, int channels,
+    int periods, float* const* data)
+{
+  webrtc::StreamConfig config(rate, channels);
+  int p, err;
+
+  engine->voice_activity = 0;
+
+  for (p = 0; p < periods; p++) {
+    float* const* planes = data + p * channels;
+
+    engine->apm->set_stream_delay_ms(engine->delay);
+
+    err = engine->apm->ProcessStream(planes, config, config, planes);
+    if (err < 0)
+      return err;
+
+    if (has_voice(engine))
+      engine->voice_activity |= 1 << p;
+  }
+
+  return 0;
+}
+
+void
+ap_voice_detection(ap_engine *engine, bool enable)
+{
+  engine->config.voice_detection.enabled = enable;
+  engine->apm->ApplyConfig(engine->config);
+  engine->voice_activity = 0;
+}
+
+int
+ap_voice_activity(ap_engine *engine)
+{
+  return engine->voice_activity;
+}
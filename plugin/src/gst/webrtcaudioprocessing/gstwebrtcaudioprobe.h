@@ -34,6 +34,10 @@
 #include <gst/base/gstbasetransform.h>
 #include <gst/audio/audio.h>
 
+#include "webrtc.h"
+#include "gstwebrtcring.h"
+#include "gstwebrtcresampler.h"
+
 #ifndef GST_USE_UNSTABLE_API
 #define GST_USE_UNSTABLE_API
 #endif
@@ -71,13 +75,71 @@ struct _GstWebrtcAudioProbe
 
   /* Protected by the lock */
   GstAudioInfo info;
+  gboolean interleaved;
   guint period_size;
   guint period_samples;
   gint delay;
   gint explicit_delay;
 
   GstSegment segment;
-  GstAdapter *adapter;
+
+  /* Hand-off of 10ms frames to the processor. The streaming thread only
+   * publishes into it, without taking the lock; the ring itself is only
+   * replaced under the lock. */
+  GstWebrtcRing *ring;
+
+  /* Far end on its way to the engine, protected by the lock. Interleaved
+   * frames are converted into the scratch planes, every frame is queued in
+   * the resampler, and batches of periods at the processor's rate pulled
+   * from it into out. The resampler and out are set up for the rate of the
+   * processor on its first period. */
+  float *scratch;
+  float **in_planes;
+  GstWebrtcResampler *resampler;
+  guint out_period_samples;
+  float *out;
+  float **out_planes;
+  float **planes;
+
+  /* Clock drift compensation, protected by the lock. The far end queued in
+   * the resampler is kept at the level it had when the stream locked, the
+   * relative correction applied to its rate is drift. */
+  gdouble drift;
+  gdouble level_target;
+  gdouble level;
+
+  /* Last delay handed to the engine, and whether delay changed since, both
+   * protected by the lock. Set on the delay property and when paired with a
+   * new engine, so a stable stream never calls ap_delay(). As far end is
+   * lined up by timestamps, delay is only what remains past the sink and
+   * the source, 0 unless set. */
+  gint engine_delay;
+  gboolean delay_pending;
+
+  /* Alignment with the capture, protected by the lock. latency is the
+   * playback latency from the last LATENCY event, last_stamp the clock time
+   * right after the newest frame queued, and estimate the smoothed time in
+   * ms far end waits before reaching the engine, negative until measured. */
+  GstClockTime latency;
+  GstClockTime last_stamp;
+  gdouble estimate;
+
+  /* Streaming thread only: samples already copied into the frame being filled */
+  guint fill;
+
+  /* Ring statistics, written by the streaming thread only and read
+   * atomically, reset when the ring is replaced */
+  gint high_water_mark;
+  gint overflow_drops;
+
+  /* Properties, protected by the object lock */
+  guint min_buffers;
+  guint max_buffers;
+
+  /* The processor this probe feeds, and the engine it owns, both set while
+   * the probe is acquired */
+  GstElement *owner;
+  ap_engine *engine;
 };
 
 struct _GstWebrtcAudioProbeClass
@@ -87,7 +149,11 @@ struct _GstWebrtcAudioProbeClass
 
 GType gst_webrtc_audio_probe_get_type (void);
 
-GstBuffer* gst_webrtc_audio_probe_read (GstWebrtcAudioProbe * self, guint * delay);
+GstWebrtcAudioProbe* gst_webrtc_audio_probe_acquire (const gchar * name, GstElement * owner, ap_engine * engine);
+
+void gst_webrtc_audio_probe_release (GstWebrtcAudioProbe * self);
+
+void gst_webrtc_audio_probe_process_reverse (GstWebrtcAudioProbe * self, GstClockTime capture_time, gint rate, guint n_periods);
 
 G_END_DECLS
 #endif /* __GST_WEBRTC_AUDIO_PROBE_H__ */
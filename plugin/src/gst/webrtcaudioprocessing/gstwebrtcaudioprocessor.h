@@ -37,6 +37,7 @@
 #ifndef GST_USE_UNSTABLE_API
 #define GST_USE_UNSTABLE_API
 #endif
+#include <gst/audio/gstplanaraudioadapter.h>
 
 G_BEGIN_DECLS
 
@@ -47,6 +48,12 @@ G_BEGIN_DECLS
 #define GST_IS_WEBRTC_AUDIO_PROCESSOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass) ,GST_TYPE_WEBRTC_AUDIO_PROCESSOR))
 #define GST_WEBRTC_AUDIO_PROCESSOR_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS((obj) ,GST_TYPE_WEBRTC_AUDIO_PROCESSOR,GstWebrtcAudioProcessorClass))
 
+typedef int GstWebrtcAudioProcessingNoiseSuppressionLevel;
+#define GST_TYPE_WEBRTC_NOISE_SUPPRESSION_LEVEL \
+    (gst_webrtc_noise_suppression_level_get_type ())
+
+GType gst_webrtc_noise_suppression_level_get_type (void);
+
 typedef struct _GstWebrtcAudioProcessor GstWebrtcAudioProcessor;
 typedef struct _GstWebrtcAudioProcessorClass GstWebrtcAudioProcessorClass;
 
@@ -57,8 +64,7 @@ struct _GstWebrtcAudioProcessorClass
 
 GType gst_webrtc_audio_processor_get_type (void);
 
-extern
-void gst_webrtc_audio_processor_set_probe();
+void gst_webrtc_audio_processor_set_probe (GstWebrtcAudioProcessor * self, const gchar * name);
 
 G_END_DECLS
 
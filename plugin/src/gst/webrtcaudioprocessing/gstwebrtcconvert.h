@@ -0,0 +1,59 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_WEBRTC_CONVERT_H__
+#define __GST_WEBRTC_CONVERT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Interleaved S16 to one float plane per channel, scaled to [-1, 1) */
+typedef void (*GstWebrtcDeinterleaveFunc) (const gint16 * src,
+    float * const * dst, guint channels, guint samples);
+
+/* One float plane per channel to interleaved S16, rounded to nearest even
+ * and saturated */
+typedef void (*GstWebrtcInterleaveFunc) (const float * const * src,
+    gint16 * dst, guint channels, guint samples);
+
+typedef struct _GstWebrtcConvertKernel GstWebrtcConvertKernel;
+
+struct _GstWebrtcConvertKernel
+{
+  const gchar *name;
+  GstWebrtcDeinterleaveFunc deinterleave;
+  GstWebrtcInterleaveFunc interleave;
+};
+
+/* The fastest kernel the running CPU supports */
+void gst_webrtc_deinterleave_s16 (const gint16 * src, float * const * dst,
+    guint channels, guint samples);
+
+void gst_webrtc_interleave_s16 (const float * const * src, gint16 * dst,
+    guint channels, guint samples);
+
+/* Every kernel the running CPU supports, the scalar reference first */
+const GstWebrtcConvertKernel* gst_webrtc_convert_kernels (guint * n_kernels);
+
+G_END_DECLS
+#endif /* __GST_WEBRTC_CONVERT_H__ */
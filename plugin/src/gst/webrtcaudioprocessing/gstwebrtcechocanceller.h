@@ -0,0 +1,104 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_WEBRTC_ECHO_CANCELLER_H__
+#define __GST_WEBRTC_ECHO_CANCELLER_H__
+
+#ifdef _WIN32
+#include <stdint.h>
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstadapter.h>
+#include <gst/base/gstaggregator.h>
+#include <gst/audio/audio.h>
+
+#include "webrtc.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_WEBRTC_ECHO_CANCELLER            (gst_webrtc_echo_canceller_get_type())
+#define GST_WEBRTC_ECHO_CANCELLER(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_WEBRTC_ECHO_CANCELLER,GstWebrtcEchoCanceller))
+#define GST_IS_WEBRTC_ECHO_CANCELLER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_WEBRTC_ECHO_CANCELLER))
+#define GST_WEBRTC_ECHO_CANCELLER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass) ,GST_TYPE_WEBRTC_ECHO_CANCELLER,GstWebrtcEchoCancellerClass))
+#define GST_IS_WEBRTC_ECHO_CANCELLER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass) ,GST_TYPE_WEBRTC_ECHO_CANCELLER))
+
+typedef struct _GstWebrtcEchoCanceller GstWebrtcEchoCanceller;
+typedef struct _GstWebrtcEchoCancellerClass GstWebrtcEchoCancellerClass;
+
+/**
+ * GstWebrtcEchoCanceller:
+ *
+ * The echo canceller object structure.
+ */
+struct _GstWebrtcEchoCanceller
+{
+  GstAggregator aggregator;
+
+  GstAggregatorPad *sinkpad;
+  GstAggregatorPad *reversepad;
+
+  /* Everything below but the properties is only touched by the aggregator's
+   * src thread, events included */
+
+  /* Near end: format, queued audio, running time of its first sample and
+   * one float plane per channel and period of a batch */
+  GstAudioInfo info;
+  guint period_samples;
+  guint period_size;
+  GstAdapter *capture;
+  GstClockTime capture_time;
+  float *scratch;
+  float **planes;
+
+  /* Far end, likewise, with the planes of a single period */
+  GstAudioInfo reverse_info;
+  guint reverse_period_samples;
+  guint reverse_period_size;
+  GstAdapter *reverse;
+  GstClockTime reverse_time;
+  float *reverse_scratch;
+  float **reverse_planes;
+
+  ap_engine *engine;
+  gboolean discont;
+
+  /* Properties, protected by the object lock. config_pending is set when
+   * one changed while the engine runs. */
+  gboolean echo_cancel;
+  gboolean noise_suppression;
+  int noise_suppression_level;
+  gboolean gain_controller;
+  gint delay;
+  gint config_pending;
+};
+
+struct _GstWebrtcEchoCancellerClass
+{
+  GstAggregatorClass parent_class;
+};
+
+GType gst_webrtc_echo_canceller_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_WEBRTC_ECHO_CANCELLER_H__ */
@@ -0,0 +1,99 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_WEBRTC_MULTI_PROCESSOR_H__
+#define __GST_WEBRTC_MULTI_PROCESSOR_H__
+
+#ifdef _WIN32
+#include <stdint.h>
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_WEBRTC_MULTI_PROCESSOR            (gst_webrtc_multi_processor_get_type())
+#define GST_WEBRTC_MULTI_PROCESSOR(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_WEBRTC_MULTI_PROCESSOR,GstWebrtcMultiProcessor))
+#define GST_IS_WEBRTC_MULTI_PROCESSOR(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_WEBRTC_MULTI_PROCESSOR))
+#define GST_WEBRTC_MULTI_PROCESSOR_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass) ,GST_TYPE_WEBRTC_MULTI_PROCESSOR,GstWebrtcMultiProcessorClass))
+#define GST_IS_WEBRTC_MULTI_PROCESSOR_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass) ,GST_TYPE_WEBRTC_MULTI_PROCESSOR))
+
+#define GST_TYPE_WEBRTC_MULTI_PROCESSOR_PAD        (gst_webrtc_multi_processor_pad_get_type())
+#define GST_WEBRTC_MULTI_PROCESSOR_PAD(obj)        (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_WEBRTC_MULTI_PROCESSOR_PAD,GstWebrtcMultiProcessorPad))
+
+typedef struct _GstWebrtcMultiProcessor GstWebrtcMultiProcessor;
+typedef struct _GstWebrtcMultiProcessorClass GstWebrtcMultiProcessorClass;
+typedef struct _GstWebrtcMultiProcessorPad GstWebrtcMultiProcessorPad;
+typedef struct _GstWebrtcMultiProcessorPadClass GstWebrtcMultiProcessorPadClass;
+typedef struct _GstWebrtcMultiStream GstWebrtcMultiStream;
+
+/**
+ * GstWebrtcMultiProcessor:
+ *
+ * The multi-stream processor object structure.
+ */
+struct _GstWebrtcMultiProcessor
+{
+  GstElement element;
+
+  /* Protected by the object lock */
+  GList *streams;
+  guint next_index;
+
+  /* Properties, applied to every stream's engine */
+  gboolean echo_cancel;
+  gboolean noise_suppression;
+  int noise_suppression_level;
+  gboolean gain_controller;
+};
+
+struct _GstWebrtcMultiProcessorClass
+{
+  GstElementClass parent_class;
+};
+
+/**
+ * GstWebrtcMultiProcessorPad:
+ *
+ * A sink pad of webrtcmultiprocessor, naming the webrtcaudioprobe that
+ * carries its stream's far end.
+ */
+struct _GstWebrtcMultiProcessorPad
+{
+  GstPad pad;
+
+  /* Protected by the object lock */
+  gchar *probe_name;
+};
+
+struct _GstWebrtcMultiProcessorPadClass
+{
+  GstPadClass parent_class;
+};
+
+GType gst_webrtc_multi_processor_get_type (void);
+GType gst_webrtc_multi_processor_pad_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_WEBRTC_MULTI_PROCESSOR_H__ */
@@ -0,0 +1,95 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_WEBRTC_RESAMPLER_H__
+#define __GST_WEBRTC_RESAMPLER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstWebrtcResampler GstWebrtcResampler;
+
+/**
+ * GstWebrtcResampler:
+ *
+ * A streaming windowed sinc resampler on non-interleaved float audio. Input
+ * is queued with gst_webrtc_resampler_push() and any amount of output the
+ * queue allows is taken with gst_webrtc_resampler_pull(). The conversion
+ * ratio can be finely adjusted while running, to follow a drifting clock,
+ * without touching the filter bank.
+ */
+struct _GstWebrtcResampler
+{
+  guint channels;
+  guint in_rate;
+  guint out_rate;
+
+  /* Input samples per output sample, nominal and currently applied */
+  gdouble nominal;
+  gdouble ratio;
+
+  /* Filter bank: one row of taps per fractional phase, plus a last row
+   * equal to the first one shifted, for interpolation between phases.
+   * Shared by every resampler between the same two rates. */
+  const gfloat *bank;
+
+  /* Taps per filter row, and the input kept ahead of the position. On
+   * reset, half - 1 zeros are queued so the first output sample sits on
+   * the first input sample. */
+  guint taps;
+  guint half;
+
+  /* One queue of input samples per channel */
+  gfloat **queue;
+  guint size;
+  guint fill;
+
+  /* Input position of the next output sample, relative to queue start */
+  gdouble position;
+};
+
+GstWebrtcResampler* gst_webrtc_resampler_new (guint channels, guint in_rate,
+    guint out_rate, guint max_pending);
+
+void gst_webrtc_resampler_free (GstWebrtcResampler * resampler);
+
+void gst_webrtc_resampler_reset (GstWebrtcResampler * resampler);
+
+void gst_webrtc_resampler_set_drift (GstWebrtcResampler * resampler,
+    gdouble drift);
+
+gboolean gst_webrtc_resampler_push (GstWebrtcResampler * resampler,
+    const float * const * in, guint samples);
+
+guint gst_webrtc_resampler_available (GstWebrtcResampler * resampler);
+
+gdouble gst_webrtc_resampler_pending (GstWebrtcResampler * resampler);
+
+void gst_webrtc_resampler_pull (GstWebrtcResampler * resampler,
+    float * const * out, guint samples);
+
+void gst_webrtc_resampler_skip (GstWebrtcResampler * resampler,
+    guint samples);
+
+G_END_DECLS
+#endif /* __GST_WEBRTC_RESAMPLER_H__ */
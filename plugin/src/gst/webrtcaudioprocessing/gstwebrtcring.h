@@ -0,0 +1,76 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_WEBRTC_RING_H__
+#define __GST_WEBRTC_RING_H__
+
+#include <atomic>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstWebrtcRing GstWebrtcRing;
+
+/**
+ * GstWebrtcRing:
+ *
+ * A preallocated single producer / single consumer ring of fixed size
+ * frames. The producer fills the frame returned by
+ * gst_webrtc_ring_write_frame() and makes it visible, along with a 64 bit
+ * stamp, with gst_webrtc_ring_publish(). The consumer reads the frame returned by
+ * gst_webrtc_ring_read_frame() and gives it back with
+ * gst_webrtc_ring_consume(). Neither side ever blocks or takes a lock.
+ */
+struct _GstWebrtcRing
+{
+  guint frame_size;
+  guint n_frames;
+  guint8 *data;
+  guint64 *stamps;
+
+  /* Counters only ever grow; n_frames is a power of two so they map to a
+   * slot with a mask, wrap around included */
+  std::atomic<guint> head;  /* written by the producer only */
+  std::atomic<guint> tail;  /* written by the consumer only */
+};
+
+GstWebrtcRing* gst_webrtc_ring_new (guint frame_size, guint n_frames);
+
+void gst_webrtc_ring_free (GstWebrtcRing * ring);
+
+guint8* gst_webrtc_ring_write_frame (GstWebrtcRing * ring);
+
+void gst_webrtc_ring_publish (GstWebrtcRing * ring, guint64 stamp);
+
+guint8* gst_webrtc_ring_read_frame (GstWebrtcRing * ring);
+
+void gst_webrtc_ring_consume (GstWebrtcRing * ring);
+
+guint64 gst_webrtc_ring_peek_stamp (GstWebrtcRing * ring, guint index);
+
+guint gst_webrtc_ring_available (GstWebrtcRing * ring);
+
+void gst_webrtc_ring_clear (GstWebrtcRing * ring);
+
+G_END_DECLS
+#endif /* __GST_WEBRTC_RING_H__ */
@@ -0,0 +1,70 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_WEBRTC_WORKERS_H__
+#define __GST_WEBRTC_WORKERS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstWebrtcWorkerQueue GstWebrtcWorkerQueue;
+
+/**
+ * GstWebrtcWorkerQueue:
+ *
+ * A queue of jobs run in order, one at a time, by a thread pool shared by
+ * the whole process and sized to the number of cores. Each session owns one
+ * queue, so its jobs never run concurrently nor out of order, while jobs of
+ * different sessions spread over the pool. A queue hands its worker back to
+ * the pool after every job, so a busy session cannot starve the others.
+ */
+struct _GstWebrtcWorkerQueue
+{
+  GFunc func;
+  gpointer user_data;
+  GDestroyNotify destroy;
+  guint max_jobs;
+
+  GMutex lock;
+  GCond cond;
+  GQueue jobs;
+  /* Set while the queue is in the pool or one of its jobs is running */
+  gboolean scheduled;
+  gboolean flushing;
+};
+
+GstWebrtcWorkerQueue* gst_webrtc_worker_queue_new (GFunc func,
+    gpointer user_data, GDestroyNotify destroy, guint max_jobs);
+
+void gst_webrtc_worker_queue_free (GstWebrtcWorkerQueue * queue);
+
+gboolean gst_webrtc_worker_queue_push (GstWebrtcWorkerQueue * queue,
+    gpointer job);
+
+void gst_webrtc_worker_queue_drain (GstWebrtcWorkerQueue * queue);
+
+void gst_webrtc_worker_queue_set_flushing (GstWebrtcWorkerQueue * queue,
+    gboolean flushing);
+
+G_END_DECLS
+#endif /* __GST_WEBRTC_WORKERS_H__ */
@@ -0,0 +1,78 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __WEBRTC_H__
+#define __WEBRTC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(AP_STATIC)
+  #define SHARED_PUBLIC
+#elif defined(_WIN32)
+  #define SHARED_PUBLIC __declspec(dllimport)
+#else
+  #define SHARED_PUBLIC __attribute__ ((visibility ("default")))
+#endif
+
+#define kMaxDataSizeSamples 7680
+#define NSL_LOW 0
+#define NSL_MODERATE 1
+#define NSL_HIGH 2
+#define NSL_VERYHIGH 3
+#define LS_VERBOSE 0
+#define LS_INFO 1
+#define LS_WARNING 2
+#define LS_ERROR 3
+#define LS_NONE 4
+
+/* Opaque audio processing engine. Each webrtcaudioprocessor owns one, and
+ * every call takes it explicitly, so a process can host any number of them. */
+typedef struct ap_engine ap_engine;
+
+extern "C" SHARED_PUBLIC ap_engine* ap_setup(int, bool, bool, int, bool, int);
+extern "C" SHARED_PUBLIC void ap_delete(ap_engine*);
+extern "C" SHARED_PUBLIC const char* ap_error(ap_engine*, int);
+extern "C" SHARED_PUBLIC void ap_delay(ap_engine*, int);
+/* Applies echo cancel, noise suppression, its level and gain control while
+ * running, keeping the engine's adaptive state */
+extern "C" SHARED_PUBLIC void ap_configure(ap_engine*, bool, bool, int, bool);
+extern "C" SHARED_PUBLIC int ap_process_reverse(ap_engine*, int, int, int16_t*);
+extern "C" SHARED_PUBLIC int ap_process(ap_engine*, int, int, int16_t*);
+
+/* Same as above on non-interleaved float audio, one plane per channel */
+extern "C" SHARED_PUBLIC int ap_process_reverse_float(ap_engine*, int, int, float* const*);
+extern "C" SHARED_PUBLIC int ap_process_float(ap_engine*, int, int, float* const*);
+
+/* Process n consecutive 10ms periods in one call. The planes of each period
+ * follow those of the previous one, n * channels in all. Stops at the first
+ * failing period and returns its error. */
+extern "C" SHARED_PUBLIC int ap_process_reverse_float_batch(ap_engine*, int, int, int, float* const*);
+extern "C" SHARED_PUBLIC int ap_process_float_batch(ap_engine*, int, int, int, float* const*);
+
+/* Enables or disables voice activity detection. While enabled, bit p of
+ * ap_voice_activity is set when period p of the last capture call had
+ * voice, period 0 for the single period calls. */
+extern "C" SHARED_PUBLIC void ap_voice_detection(ap_engine*, bool);
+extern "C" SHARED_PUBLIC int ap_voice_activity(ap_engine*);
+
+#endif /* __WEBRTC_H__ */
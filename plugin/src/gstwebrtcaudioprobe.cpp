@@ -33,29 +33,55 @@
 #include "config.h"
 #endif
 
-#include "gst/webrtcaudioprocessing/gstwebrtcaudioprobe.h"
-
-#ifdef _WIN32
-  #define SHARED_PUBLIC __declspec(dllimport)
-#else
-  #define SHARED_PUBLIC __attribute__ ((visibility ("default")))
-#endif
+#include <math.h>
+#include <string.h>
 
-// should go in a webrtc.h
-#define kMaxDataSizeSamples 7680
-extern "C" SHARED_PUBLIC const char* ap_error(int);
-extern "C" SHARED_PUBLIC void ap_setup(int, bool, bool, int, bool, int);
-extern "C" SHARED_PUBLIC void ap_delete();
-extern "C" SHARED_PUBLIC void ap_delay(int);
-extern "C" SHARED_PUBLIC int ap_process_reverse(int, int, int16_t*);
-extern "C" SHARED_PUBLIC int ap_process(int, int, int16_t*);
+#include "gst/webrtcaudioprocessing/gstwebrtcaudioprobe.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcconvert.h"
 
 GST_DEBUG_CATEGORY_EXTERN (webrtc_audio_processor_debug);
 #define GST_CAT_DEFAULT (webrtc_audio_processor_debug)
 
-#define MAX_ADAPTER_SIZE (1*1024*1024)
+/* Frames handed to the engine per call */
+#define MAX_BATCH_PERIODS 10
+
+/* No delay handed to the engine yet */
+#define NO_DELAY G_MININT
+
+#define PERIOD_DURATION (10 * GST_MSECOND)
+
+/* Alignment: the far end handed to the engine with a capture period is the
+ * one played at the period's clock time. An offset beyond ALIGN_TOLERANCE,
+ * at start or after a gap, is corrected at once, smaller ones are left to
+ * drift compensation. Far end gaps up to MAX_GAP are filled with silence,
+ * longer ones restart the queue. */
+#define ALIGN_TOLERANCE (30 * GST_MSECOND)
+#define MAX_GAP GST_SECOND
+
+/* Delay estimation: the far end shift, clamped to what the delay property
+ * accepts and smoothed with an exponential moving average */
+#define MAX_DELAY 1500
+#define DELAY_SMOOTHING 0.05
+
+/* The ring only holds the far end published between two batches of the
+ * processor, a few batches leaving room for a late one. The ring rounds it
+ * up to a power of two. The delay waits in the resampler queue, sized for
+ * the longest delay plus a batch, in ms. */
+#define RING_PERIODS (4 * MAX_BATCH_PERIODS)
+#define QUEUE_DURATION (MAX_DELAY + MAX_BATCH_PERIODS * 10)
+
+/* Drift compensation: the queued far end level, which jumps by whole
+ * periods, is smoothed by LEVEL_SMOOTHING per 10ms period, over about 20s,
+ * and a level off by x seconds corrects the far end rate by
+ * x / DRIFT_TIME_CONSTANT, up to MAX_DRIFT. A steady drift d thus settles
+ * with d * DRIFT_TIME_CONSTANT more far end queued, 9ms for 300 ppm. */
+#define LEVEL_SMOOTHING 0.0005
+#define DRIFT_TIME_CONSTANT 30.0
+#define MAX_DRIFT 0.002
 
 #define DEFAULT_EXPLICIT_DELAY -1
+#define DEFAULT_MIN_BUFFERS 4
+#define DEFAULT_MAX_BUFFERS 0
 
 static GstStaticPadTemplate gst_webrtc_audio_probe_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
@@ -64,7 +90,12 @@ GST_STATIC_PAD_TEMPLATE ("sink",
     GST_STATIC_CAPS ("audio/x-raw, "
         "format = (string) " GST_AUDIO_NE (S16) ", "
         "layout = (string) interleaved, "
-        "rate = (int) { 48000, 32000, 16000, 8000 }, "
+        "rate = (int) [ 8000, 192000 ], "
+        "channels = (int) [1, MAX];"
+        "audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (F32) ", "
+        "layout = (string) non-interleaved, "
+        "rate = (int) [ 8000, 192000 ], "
         "channels = (int) [1, MAX]")
     );
 
@@ -75,23 +106,113 @@ GST_STATIC_PAD_TEMPLATE ("src",
     GST_STATIC_CAPS ("audio/x-raw, "
         "format = (string) " GST_AUDIO_NE (S16) ", "
         "layout = (string) interleaved, "
-        "rate = (int) { 48000, 32000, 16000, 8000 }, "
+        "rate = (int) [ 8000, 192000 ], "
+        "channels = (int) [1, MAX];"
+        "audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (F32) ", "
+        "layout = (string) non-interleaved, "
+        "rate = (int) [ 8000, 192000 ], "
         "channels = (int) [1, MAX]")
     );
 
 G_DEFINE_TYPE (GstWebrtcAudioProbe, gst_webrtc_audio_probe,
     GST_TYPE_AUDIO_FILTER);
 
+/* Every live probe, in creation order */
+G_LOCK_DEFINE_STATIC (gst_webrtc_audio_probes);
+static GList *gst_webrtc_audio_probes = NULL;
+
 enum
 {
   PROP_0,
   PROP_EXPLICIT_DELAY,
+  PROP_MIN_BUFFERS,
+  PROP_MAX_BUFFERS,
+  PROP_ESTIMATED_DELAY,
+  PROP_DRIFT,
+  PROP_HIGH_WATER_MARK,
+  PROP_OVERFLOW_DROPS,
 };
 
+static void
+gst_webrtc_audio_probe_free_output (GstWebrtcAudioProbe * self)
+{
+  gst_webrtc_resampler_free (self->resampler);
+  self->resampler = NULL;
+  g_free (self->out);
+  self->out = NULL;
+  g_free (self->out_planes);
+  self->out_planes = NULL;
+  g_free (self->planes);
+  self->planes = NULL;
+}
+
+static void
+gst_webrtc_audio_probe_free_buffers (GstWebrtcAudioProbe * self)
+{
+  g_free (self->scratch);
+  self->scratch = NULL;
+  g_free (self->in_planes);
+  self->in_planes = NULL;
+  gst_webrtc_audio_probe_free_output (self);
+}
+
+/* Starts over with an empty far end queue, relocking on the next period.
+ * Called with the lock held. */
+static void
+gst_webrtc_audio_probe_reset_drift (GstWebrtcAudioProbe * self)
+{
+  if (self->resampler) {
+    gst_webrtc_resampler_reset (self->resampler);
+    gst_webrtc_resampler_set_drift (self->resampler, 0);
+  }
+
+  self->drift = 0;
+  self->level_target = -1;
+  self->level = 0;
+}
+
+/* Sets up resampling of the far end to rate, the processor's. Called with
+ * the lock held. */
+static void
+gst_webrtc_audio_probe_configure_output (GstWebrtcAudioProbe * self,
+    gint rate)
+{
+  guint channels = self->info.channels;
+  guint p, c;
+
+  if (self->resampler && self->resampler->out_rate == (guint) rate)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Resampling far end from %i Hz to %i Hz",
+      self->info.rate, rate);
+
+  gst_webrtc_audio_probe_free_output (self);
+
+  self->resampler = gst_webrtc_resampler_new (channels, self->info.rate, rate,
+      gst_util_uint64_scale_int (QUEUE_DURATION, self->info.rate, 1000));
+  self->out_period_samples = rate / 100;
+  self->out = g_new (float,
+      MAX_BATCH_PERIODS * channels * self->out_period_samples);
+  self->out_planes = g_new (float *, channels);
+  self->planes = g_new (float *, MAX_BATCH_PERIODS * channels);
+
+  for (c = 0; c < channels; c++) {
+    self->out_planes[c] = self->out + c * MAX_BATCH_PERIODS * self->out_period_samples;
+
+    for (p = 0; p < MAX_BATCH_PERIODS; p++)
+      self->planes[p * channels + c] =
+          self->out_planes[c] + p * self->out_period_samples;
+  }
+
+  gst_webrtc_audio_probe_reset_drift (self);
+}
+
 static gboolean
 gst_webrtc_audio_probe_setup (GstAudioFilter * filter, const GstAudioInfo * info)
 {
   GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (filter);
+  guint c;
 
   GST_LOG_OBJECT (self, "setting format to %s with %i Hz and %i channels",
       info->finfo->description, info->rate, info->channels);
@@ -99,11 +220,31 @@ gst_webrtc_audio_probe_setup (GstAudioFilter * filter, const GstAudioInfo * info
   GST_WEBRTC_AUDIO_PROBE_LOCK (self);
 
   self->info = *info;
+  self->interleaved = (info->layout == GST_AUDIO_LAYOUT_INTERLEAVED);
 
   /* WebRTC works with 10ms (.01s) buffers, compute period_size once */
   self->period_samples = info->rate / 100;
   self->period_size = self->period_samples * info->bpf;
 
+  /* Called from the streaming thread, so nothing is being published */
+  gst_webrtc_ring_free (self->ring);
+  self->ring = gst_webrtc_ring_new (self->period_size, RING_PERIODS);
+  self->fill = 0;
+  g_atomic_int_set (&self->high_water_mark, 0);
+  g_atomic_int_set (&self->overflow_drops, 0);
+
+  gst_webrtc_audio_probe_free_buffers (self);
+
+  self->scratch = g_new (float, info->channels * self->period_samples);
+  self->in_planes = g_new (float *, info->channels);
+
+  /* Interleaved frames are always converted into the scratch planes, those
+   * of non-interleaved frames are pointed at when queued */
+  for (c = 0; c < (guint) info->channels; c++)
+    self->in_planes[c] = self->scratch + c * self->period_samples;
+
+  gst_webrtc_audio_probe_reset_drift (self);
+
   GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
 
   return TRUE;
@@ -115,12 +256,61 @@ gst_webrtc_audio_probe_stop (GstBaseTransform * btrans)
   GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (btrans);
 
   GST_WEBRTC_AUDIO_PROBE_LOCK (self);
-  gst_adapter_clear (self->adapter);
+  if (self->ring)
+    gst_webrtc_ring_clear (self->ring);
+  self->fill = 0;
+  self->last_stamp = GST_CLOCK_TIME_NONE;
+  self->estimate = -1;
+  gst_webrtc_audio_probe_reset_drift (self);
   GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
 
   return TRUE;
 }
 
+/* The probe is passthrough, so downstream gets the first say. When it has no
+ * pool to offer, propose one of 10ms buffers so the playback path recycles
+ * its buffers too. */
+static gboolean
+gst_webrtc_audio_probe_propose_allocation (GstBaseTransform * btrans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (btrans);
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstCaps *caps;
+  guint period_size, min_buffers, max_buffers;
+
+  if (!GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_probe_parent_class)->propose_allocation (btrans, decide_query, query))
+    return FALSE;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  GST_WEBRTC_AUDIO_PROBE_LOCK (self);
+  period_size = self->period_size;
+  GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
+
+  if (!caps || gst_query_get_n_allocation_pools (query) > 0 || period_size == 0)
+    return TRUE;
+
+  GST_OBJECT_LOCK (self);
+  min_buffers = self->min_buffers;
+  max_buffers = self->max_buffers;
+  GST_OBJECT_UNLOCK (self);
+
+  pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, period_size,
+      min_buffers, max_buffers);
+
+  if (gst_buffer_pool_set_config (pool, config))
+    gst_query_add_allocation_pool (query, pool, period_size,
+        min_buffers, max_buffers);
+
+  gst_object_unref (pool);
+
+  return TRUE;
+}
+
 static gboolean
 gst_webrtc_audio_probe_src_event (GstBaseTransform * btrans, GstEvent * event)
 {
@@ -134,12 +324,13 @@ gst_webrtc_audio_probe_src_event (GstBaseTransform * btrans, GstEvent * event)
     case GST_EVENT_LATENCY:
       gst_event_parse_latency (event, &delay);
 
+      /* Far end is played latency after its clock time, alignment picks
+       * it up on the next period */
       GST_WEBRTC_AUDIO_PROBE_LOCK (self);
-      self->delay = (self->explicit_delay != -1) ? self->explicit_delay : (delay / GST_MSECOND);
+      self->latency = delay;
       GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
-      
-      GST_DEBUG_OBJECT (self, "***Estimated*** delay of %" GST_TIME_FORMAT, GST_TIME_ARGS (delay));
-      GST_DEBUG_OBJECT (self, "Using a delay of %ims", self->delay);
+
+      GST_DEBUG_OBJECT (self, "Playback latency of %" GST_TIME_FORMAT, GST_TIME_ARGS (delay));
       break;
     default:
       break;
@@ -148,75 +339,403 @@ gst_webrtc_audio_probe_src_event (GstBaseTransform * btrans, GstEvent * event)
   return klass->src_event (btrans, event);
 }
 
-static void process_reverse(GstWebrtcAudioProbe * self, GstBuffer* buffer)
+static GstFlowReturn
+gst_webrtc_audio_probe_transform_ip (GstBaseTransform * btrans,
+    GstBuffer * buffer)
 {
+  GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (btrans);
   GstAudioBuffer abuf;
-  gst_audio_buffer_map (&abuf, &self->info, buffer, (GstMapFlags) GST_MAP_READ);
+  GstClockTime start;
+  guint stride, plane, queued, offset = 0;
+
+  /* No lock here: the playback thread only publishes frames, the processor
+   * consumes them from its own streaming thread. */
+  if (!self->ring)
+    return GST_FLOW_OK;
+
+  if (!gst_audio_buffer_map (&abuf, &self->info, buffer, GST_MAP_READ))
+    return GST_FLOW_ERROR;
+
+  if (GST_BUFFER_IS_DISCONT (buffer))
+    self->fill = 0;
+
+  /* Frames are stamped with the clock time their last sample is played,
+   * before playback latency, to line them up with the capture */
+  start = gst_segment_to_running_time (&btrans->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  if (GST_CLOCK_TIME_IS_VALID (start))
+    start += gst_element_get_base_time (GST_ELEMENT (self));
+
+  /* A frame holds one plane per channel of non-interleaved audio, laid out
+   * one after the other, or a single interleaved plane */
+  stride = self->interleaved ? GST_AUDIO_INFO_BPF (&self->info) :
+      GST_AUDIO_INFO_BPS (&self->info);
+
+  while (offset < abuf.n_samples) {
+    guint8 *frame = gst_webrtc_ring_write_frame (self->ring);
+    guint n;
+
+    /* The rest of the buffer is dropped along with any frame it was
+     * completing, so that no frame holds audio from both sides of the gap */
+    if (!frame) {
+      GST_LOG_OBJECT (self, "Ring full, dropping %" G_GSIZE_FORMAT " samples.",
+          self->fill + abuf.n_samples - offset);
+      g_atomic_int_add (&self->overflow_drops,
+          (self->fill + abuf.n_samples - offset + self->period_samples - 1) /
+          self->period_samples);
+      self->fill = 0;
+      break;
+    }
 
-  int16_t * const data = (int16_t * const) abuf.planes[0];
-  int err;
-  
-  err = ap_process_reverse(self->info.rate, self->info.channels, data);
+    n = MIN (self->period_samples - self->fill, abuf.n_samples - offset);
 
-  if (err < 0)
-    GST_WARNING_OBJECT (self, "Failed to reverse process audio: %s.",
-        ap_error (err));
+    for (plane = 0; plane < (guint) abuf.n_planes; plane++)
+      memcpy (frame + (plane * self->period_samples + self->fill) * stride,
+          (guint8 *) abuf.planes[plane] + offset * stride, n * stride);
+
+    self->fill += n;
+    offset += n;
+
+    if (self->fill == self->period_samples) {
+      gst_webrtc_ring_publish (self->ring, GST_CLOCK_TIME_IS_VALID (start) ?
+          start + gst_util_uint64_scale_int (offset, GST_SECOND, self->info.rate) :
+          GST_CLOCK_TIME_NONE);
+      self->fill = 0;
+
+      /* Seen from here the consumer may lag, so this is an upper bound */
+      queued = gst_webrtc_ring_available (self->ring);
+      if (queued > (guint) g_atomic_int_get (&self->high_water_mark))
+        g_atomic_int_set (&self->high_water_mark, queued);
+    }
+  }
 
   gst_audio_buffer_unmap (&abuf);
+
+  return GST_FLOW_OK;
 }
 
-static GstFlowReturn
-gst_webrtc_audio_probe_transform_ip (GstBaseTransform * btrans,
-    GstBuffer * buffer)
+/* Queues samples of silence in the resampler, in periods. Called with the
+ * lock held. */
+static void
+gst_webrtc_audio_probe_queue_silence (GstWebrtcAudioProbe * self,
+    guint samples)
 {
-  GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (btrans);
+  guint channels = self->info.channels;
+  guint c, n;
+
+  memset (self->scratch, 0, channels * self->period_samples * sizeof (float));
+  for (c = 0; c < channels; c++)
+    self->in_planes[c] = self->scratch + c * self->period_samples;
+
+  while (samples > 0) {
+    n = MIN (samples, self->period_samples);
+    gst_webrtc_resampler_push (self->resampler,
+        (const float * const *) self->in_planes, n);
+    samples -= n;
+  }
+}
+
+/* The resampler queue is taken as contiguous up to the newest frame. A
+ * frame not following the previous one fills the gap with silence, or
+ * restarts the queue when it is too long or goes back in time. Called with
+ * the lock held. */
+static void
+gst_webrtc_audio_probe_check_stamp (GstWebrtcAudioProbe * self,
+    GstClockTime stamp)
+{
+  GstClockTime expected;
+  GstClockTimeDiff gap;
+
+  if (!GST_CLOCK_TIME_IS_VALID (stamp) ||
+      !GST_CLOCK_TIME_IS_VALID (self->last_stamp))
+    return;
+
+  expected = self->last_stamp + gst_util_uint64_scale_int (self->period_samples,
+      GST_SECOND, self->info.rate);
+  gap = GST_CLOCK_DIFF (expected, stamp);
+
+  if (ABS (gap) < PERIOD_DURATION / 2)
+    return;
+
+  if (gap > 0 && gap <= (GstClockTimeDiff) MAX_GAP) {
+    GST_LOG_OBJECT (self, "Far end gap of %" GST_STIME_FORMAT
+        ", filling with silence", GST_STIME_ARGS (gap));
+    gst_webrtc_audio_probe_queue_silence (self,
+        gst_util_uint64_scale_int (gap, self->info.rate, GST_SECOND));
+  } else {
+    GST_DEBUG_OBJECT (self, "Far end jumped by %" GST_STIME_FORMAT
+        ", restarting its queue", GST_STIME_ARGS (gap));
+    gst_webrtc_resampler_reset (self->resampler);
+    self->level_target = -1;
+  }
+}
+
+/* Moves every published frame into the resampler. Called with the lock
+ * held. */
+static void
+gst_webrtc_audio_probe_queue_frames (GstWebrtcAudioProbe * self)
+{
+  guint channels = self->info.channels;
+  GstClockTime stamp;
+  guint8 *frame;
+  guint plane;
+
+  while ((frame = gst_webrtc_ring_read_frame (self->ring))) {
+    stamp = gst_webrtc_ring_peek_stamp (self->ring, 0);
+
+    gst_webrtc_audio_probe_check_stamp (self, stamp);
+
+    if (self->interleaved)
+      gst_webrtc_deinterleave_s16 ((const gint16 *) frame, self->in_planes,
+          channels, self->period_samples);
+    else {
+      for (plane = 0; plane < channels; plane++)
+        self->in_planes[plane] = (float *) frame + plane * self->period_samples;
+    }
+
+    if (!gst_webrtc_resampler_push (self->resampler,
+            (const float * const *) self->in_planes, self->period_samples))
+      GST_LOG_OBJECT (self, "Far end queue full, dropped its oldest audio.");
+
+    if (GST_CLOCK_TIME_IS_VALID (stamp))
+      self->last_stamp = stamp;
+
+    gst_webrtc_ring_consume (self->ring);
+  }
+}
+
+/* The probe and the processor run off different device clocks, so far end
+ * periods arrive at a slightly different rate than capture periods are
+ * processed. The difference accumulates as far end queued in the
+ * resampler: its level, once smoothed, gives the relative rate error, and
+ * the resampler consumes the far end that much faster or slower so the
+ * engine gets exactly one far end period per capture period. Called with
+ * the lock held, after a batch of n_periods was pulled. */
+static void
+gst_webrtc_audio_probe_track_drift (GstWebrtcAudioProbe * self,
+    guint n_periods)
+{
+  gdouble level = gst_webrtc_resampler_pending (self->resampler);
+
+  /* Relocking after a jump keeps the current correction */
+  if (self->level_target < 0) {
+    self->level_target = level -
+        self->drift * self->info.rate * DRIFT_TIME_CONSTANT;
+    self->level = level;
+    return;
+  }
+
+  /* The same smoothing whatever the batch size */
+  self->level += (1.0 - pow (1.0 - LEVEL_SMOOTHING, n_periods)) *
+      (level - self->level);
+
+  self->drift = (self->level - self->level_target) /
+      (self->info.rate * DRIFT_TIME_CONSTANT);
+  self->drift = CLAMP (self->drift, -MAX_DRIFT, MAX_DRIFT);
+
+  gst_webrtc_resampler_set_drift (self->resampler, self->drift);
+}
+
+/* Lines the far end queue up with the capture period starting at
+ * capture_time, a clock time: the next far end sample handed to the engine
+ * should be the one played then. Older far end is skipped. When the far end
+ * starts later, returns the number of capture periods it has none for.
+ * Called with the lock held. */
+static guint
+gst_webrtc_audio_probe_align (GstWebrtcAudioProbe * self,
+    GstClockTime capture_time)
+{
+  GstClockTime latency;
+  gdouble pending, head, offset, shift;
+
+  if (!GST_CLOCK_TIME_IS_VALID (capture_time) ||
+      !GST_CLOCK_TIME_IS_VALID (self->last_stamp))
+    return 0;
+
+  /* Without a LATENCY event, buffers are played at their clock time */
+  latency = GST_CLOCK_TIME_IS_VALID (self->latency) ? self->latency : 0;
+
+  /* Clock time the next queued far end sample is played at */
+  pending = gst_webrtc_resampler_pending (self->resampler);
+  head = (gdouble) (self->last_stamp + latency) -
+      pending * GST_SECOND / self->info.rate;
+  offset = head - capture_time;
+
+  /* How long far end waits in the probe before reaching the engine */
+  shift = CLAMP (latency - offset, 0, MAX_DELAY * GST_MSECOND) / GST_MSECOND;
+  if (self->estimate < 0)
+    self->estimate = shift;
+  else
+    self->estimate += DELAY_SMOOTHING * (shift - self->estimate);
+
+  if (offset < -(gdouble) ALIGN_TOLERANCE) {
+    GST_LOG_OBJECT (self, "Far end %.1fms behind, skipping it",
+        -offset / GST_MSECOND);
+    gst_webrtc_resampler_skip (self->resampler,
+        (guint) (-offset * self->info.rate / GST_SECOND + 0.5));
+    self->level_target = -1;
+  } else if (offset > (gdouble) ALIGN_TOLERANCE) {
+    GST_LOG_OBJECT (self, "Far end %.1fms ahead, holding it back",
+        offset / GST_MSECOND);
+    return (guint) (offset / PERIOD_DURATION);
+  }
+
+  return 0;
+}
+
+/* Hands the owner's engine the far end played during each capture period
+ * about to be processed, as far as queued audio allows. Called by the
+ * owning processor from its streaming thread, right before processing
+ * n_periods capture periods at rate starting at capture_time, a clock time
+ * or GST_CLOCK_TIME_NONE. Without clock times, far end periods are handed
+ * in order, one per capture period. */
+void
+gst_webrtc_audio_probe_process_reverse (GstWebrtcAudioProbe * self,
+    GstClockTime capture_time, gint rate, guint n_periods)
+{
+  guint channels, n;
+  int err;
 
   GST_WEBRTC_AUDIO_PROBE_LOCK (self);
 
-  gst_buffer_ref (buffer);
-  gst_adapter_push (self->adapter, buffer);
+  if (!self->engine || !self->ring) {
+    GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
+    return;
+  }
+
+  channels = self->info.channels;
 
-  if (gst_adapter_available (self->adapter) > MAX_ADAPTER_SIZE)
-    gst_adapter_flush (self->adapter, gst_adapter_available (self->adapter) - MAX_ADAPTER_SIZE);
+  gst_webrtc_audio_probe_configure_output (self, rate);
+  gst_webrtc_audio_probe_queue_frames (self);
 
-  GstBuffer* buf;
+  n_periods -= MIN (gst_webrtc_audio_probe_align (self, capture_time), n_periods);
 
-  do {
-    if (gst_adapter_available (self->adapter) < self->period_size)
-      buf = NULL;
-    else
-    {
-      buf = gst_adapter_take_buffer (self->adapter, self->period_size);
-      ap_delay (self->delay);
-      process_reverse(self, buf);
-      gst_buffer_unref (buf);
+  while (n_periods > 0) {
+    n = MIN (n_periods, MAX_BATCH_PERIODS);
+    n = MIN (n, gst_webrtc_resampler_available (self->resampler) /
+        self->out_period_samples);
+
+    if (n == 0)
+      break;
+
+    gst_webrtc_resampler_pull (self->resampler, self->out_planes,
+        n * self->out_period_samples);
+    gst_webrtc_audio_probe_track_drift (self, n);
+
+    if (self->delay_pending) {
+      if (self->delay != self->engine_delay) {
+        GST_DEBUG_OBJECT (self, "Handing a delay of %ims to the engine", self->delay);
+        ap_delay (self->engine, self->delay);
+        self->engine_delay = self->delay;
+      }
+      self->delay_pending = FALSE;
     }
+
+    err = ap_process_reverse_float_batch(self->engine, rate, channels, n, self->planes);
+
+    if (err < 0)
+      GST_WARNING_OBJECT (self, "Failed to reverse process audio: %s.",
+          ap_error (self->engine, err));
+
+    n_periods -= n;
   }
-  while (buf);
 
   GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
+}
 
-  return GST_FLOW_OK;
+/* The outermost bin holding object, or object itself. Returns a new
+ * reference. */
+static GstObject *
+gst_webrtc_audio_probe_get_toplevel (GstObject * object)
+{
+  GstObject *parent;
+
+  gst_object_ref (object);
+  while ((parent = gst_object_get_parent (object))) {
+    gst_object_unref (object);
+    object = parent;
+  }
+
+  return object;
 }
 
-GstBuffer*
-gst_webrtc_audio_probe_read (GstWebrtcAudioProbe * self, guint * delay)
+/* Binds the probe called name, or the first free probe when name is NULL, to
+ * owner, which from now on receives the far end signal through engine.
+ * Element names are only unique within a bin, so probes in the same
+ * top-level pipeline as owner are preferred, then probes anywhere in the
+ * process, which must then be named uniquely across pipelines. Returns a
+ * new reference, or NULL when no such probe is free. */
+GstWebrtcAudioProbe*
+gst_webrtc_audio_probe_acquire (const gchar * name, GstElement * owner, ap_engine * engine)
 {
-  GstBuffer* buffer;
-  
-  GST_WEBRTC_AUDIO_PROBE_LOCK (self);
-  
-  if (gst_adapter_available (self->adapter) < self->period_size)
-    buffer = NULL;
-  else
-  {
-    buffer = gst_adapter_take_buffer (self->adapter, self->period_size);;
-    * delay = self->delay;
+  GstWebrtcAudioProbe *ret = NULL;
+  GstObject *toplevel, *probe_toplevel;
+  gboolean match, same_pipeline;
+  guint pass;
+  GList *l;
+
+  toplevel = gst_webrtc_audio_probe_get_toplevel (GST_OBJECT (owner));
+
+  G_LOCK (gst_webrtc_audio_probes);
+
+  for (pass = 0; pass < 2 && !ret; pass++) {
+    for (l = gst_webrtc_audio_probes; l && !ret; l = l->next) {
+      GstWebrtcAudioProbe *probe = GST_WEBRTC_AUDIO_PROBE (l->data);
+
+      if (name) {
+        GST_OBJECT_LOCK (probe);
+        match = g_strcmp0 (GST_OBJECT_NAME (probe), name) == 0;
+        GST_OBJECT_UNLOCK (probe);
+
+        if (!match)
+          continue;
+      }
+
+      probe_toplevel = gst_webrtc_audio_probe_get_toplevel (GST_OBJECT (probe));
+      same_pipeline = probe_toplevel == toplevel;
+      gst_object_unref (probe_toplevel);
+
+      /* Same pipeline first, the others on the second pass */
+      if (same_pipeline != (pass == 0))
+        continue;
+
+      GST_WEBRTC_AUDIO_PROBE_LOCK (probe);
+      if (!probe->owner) {
+        probe->owner = owner;
+        probe->engine = engine;
+        probe->engine_delay = NO_DELAY;
+        probe->delay_pending = TRUE;
+        probe->last_stamp = GST_CLOCK_TIME_NONE;
+        probe->estimate = -1;
+        gst_webrtc_audio_probe_reset_drift (probe);
+        /* Frames recorded while unpaired are stale by now */
+        if (probe->ring)
+          gst_webrtc_ring_clear (probe->ring);
+        ret = GST_WEBRTC_AUDIO_PROBE (gst_object_ref (probe));
+      }
+      GST_WEBRTC_AUDIO_PROBE_UNLOCK (probe);
+    }
   }
 
+  G_UNLOCK (gst_webrtc_audio_probes);
+
+  gst_object_unref (toplevel);
+
+  return ret;
+}
+
+/* Detaches the probe from its owner's engine and drops the reference
+ * returned by gst_webrtc_audio_probe_acquire(). Once this returns the probe
+ * no longer touches the engine, so the owner may delete it. */
+void
+gst_webrtc_audio_probe_release (GstWebrtcAudioProbe * self)
+{
+  GST_WEBRTC_AUDIO_PROBE_LOCK (self);
+  self->owner = NULL;
+  self->engine = NULL;
   GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
 
-  return buffer;
+  gst_object_unref (self);
 }
 
 static void
@@ -230,6 +749,16 @@ gst_webrtc_audio_probe_set_property (GObject * object,
     case PROP_EXPLICIT_DELAY:
       self->explicit_delay =
           g_value_get_int (value);
+      GST_WEBRTC_AUDIO_PROBE_LOCK (self);
+      self->delay = (self->explicit_delay != -1) ? self->explicit_delay : 0;
+      self->delay_pending = TRUE;
+      GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
+      break;
+    case PROP_MIN_BUFFERS:
+      self->min_buffers = g_value_get_uint (value);
+      break;
+    case PROP_MAX_BUFFERS:
+      self->max_buffers = g_value_get_uint (value);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -249,6 +778,28 @@ gst_webrtc_audio_probe_get_property (GObject * object,
     case PROP_EXPLICIT_DELAY:
       g_value_set_int (value, self->explicit_delay);
       break;
+    case PROP_MIN_BUFFERS:
+      g_value_set_uint (value, self->min_buffers);
+      break;
+    case PROP_MAX_BUFFERS:
+      g_value_set_uint (value, self->max_buffers);
+      break;
+    case PROP_ESTIMATED_DELAY:
+      GST_WEBRTC_AUDIO_PROBE_LOCK (self);
+      g_value_set_int (value, self->estimate < 0 ? -1 : (gint) (self->estimate + 0.5));
+      GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
+      break;
+    case PROP_DRIFT:
+      GST_WEBRTC_AUDIO_PROBE_LOCK (self);
+      g_value_set_double (value, self->drift * 1e6);
+      GST_WEBRTC_AUDIO_PROBE_UNLOCK (self);
+      break;
+    case PROP_HIGH_WATER_MARK:
+      g_value_set_uint (value, g_atomic_int_get (&self->high_water_mark));
+      break;
+    case PROP_OVERFLOW_DROPS:
+      g_value_set_uint (value, g_atomic_int_get (&self->overflow_drops));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -256,13 +807,30 @@ gst_webrtc_audio_probe_get_property (GObject * object,
   GST_OBJECT_UNLOCK (self);
 }
 
+/* Leaves the list of live probes while still referenced, so acquire never
+ * refs a probe being finalized. A probe acquired meanwhile is kept alive by
+ * that reference, only no longer found by name. May run more than once. */
+static void
+gst_webrtc_audio_probe_dispose (GObject * object)
+{
+  GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (object);
+
+  G_LOCK (gst_webrtc_audio_probes);
+  gst_webrtc_audio_probes = g_list_remove (gst_webrtc_audio_probes, self);
+  G_UNLOCK (gst_webrtc_audio_probes);
+
+  G_OBJECT_CLASS (gst_webrtc_audio_probe_parent_class)->dispose (object);
+}
+
 static void
 gst_webrtc_audio_probe_finalize (GObject * object)
 {
   GstWebrtcAudioProbe *self = GST_WEBRTC_AUDIO_PROBE (object);
 
-  gst_object_unref (self->adapter);
-  self->adapter = NULL;
+  gst_webrtc_ring_free (self->ring);
+  self->ring = NULL;
+  gst_webrtc_audio_probe_free_buffers (self);
+  g_mutex_clear (&self->lock);
 
   G_OBJECT_CLASS (gst_webrtc_audio_probe_parent_class)->finalize (object);
 }
@@ -270,11 +838,19 @@ gst_webrtc_audio_probe_finalize (GObject * object)
 static void
 gst_webrtc_audio_probe_init (GstWebrtcAudioProbe * self)
 {
-  self->adapter = gst_adapter_new ();
   gst_audio_info_init (&self->info);
   g_mutex_init (&self->lock);
 
   self->delay = (self->explicit_delay != -1) ? self->explicit_delay : 0;
+  self->engine_delay = NO_DELAY;
+  self->latency = GST_CLOCK_TIME_NONE;
+  self->last_stamp = GST_CLOCK_TIME_NONE;
+  self->estimate = -1;
+  self->level_target = -1;
+
+  G_LOCK (gst_webrtc_audio_probes);
+  gst_webrtc_audio_probes = g_list_append (gst_webrtc_audio_probes, self);
+  G_UNLOCK (gst_webrtc_audio_probes);
 }
 
 static void
@@ -285,6 +861,7 @@ gst_webrtc_audio_probe_class_init (GstWebrtcAudioProbeClass * klass)
   GstBaseTransformClass *btrans_class = GST_BASE_TRANSFORM_CLASS (klass);
   GstAudioFilterClass *audiofilter_class = GST_AUDIO_FILTER_CLASS (klass);
 
+  gobject_class->dispose = gst_webrtc_audio_probe_dispose;
   gobject_class->finalize = gst_webrtc_audio_probe_finalize;
   gobject_class->set_property = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_set_property);
   gobject_class->get_property = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_get_property);
@@ -293,6 +870,7 @@ gst_webrtc_audio_probe_class_init (GstWebrtcAudioProbeClass * klass)
   btrans_class->src_event = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_src_event);
   btrans_class->transform_ip = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_transform_ip);
   btrans_class->stop = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_stop);
+  btrans_class->propose_allocation = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_propose_allocation);
 
   audiofilter_class->setup = GST_DEBUG_FUNCPTR (gst_webrtc_audio_probe_setup);
 
@@ -302,10 +880,57 @@ gst_webrtc_audio_probe_class_init (GstWebrtcAudioProbeClass * klass)
   g_object_class_install_property (gobject_class,
       PROP_EXPLICIT_DELAY,
       g_param_spec_int ("delay", "Explicit Delay",
-          "Explicit delay between far end and near end in ms.",
+          "Echo path delay in ms left once the far end is lined up with the "
+          "near end by timestamps, the acoustic path mostly (-1 = none).",
           -1, 1500, DEFAULT_EXPLICIT_DELAY, (GParamFlags) (G_PARAM_READWRITE |
               G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
 
+  g_object_class_install_property (gobject_class,
+      PROP_MIN_BUFFERS,
+      g_param_spec_uint ("min-buffers", "Min Buffers",
+          "Number of 10ms buffers preallocated in the proposed buffer pool",
+          0, G_MAXUINT, DEFAULT_MIN_BUFFERS, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_MAX_BUFFERS,
+      g_param_spec_uint ("max-buffers", "Max Buffers",
+          "Maximum number of 10ms buffers in the proposed buffer pool (0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_MAX_BUFFERS, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_ESTIMATED_DELAY,
+      g_param_spec_int ("estimated-delay", "Estimated Delay",
+          "Time in ms the far end is held back to line up with the near end, "
+          "from the timestamps of both streams and the playback latency "
+          "(-1 = not yet measured)",
+          -1, MAX_DELAY, -1, (GParamFlags) (G_PARAM_READABLE |
+              G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_DRIFT,
+      g_param_spec_double ("drift", "Drift",
+          "Correction in ppm applied to the far end rate to follow the "
+          "capture clock",
+          -MAX_DRIFT * 1e6, MAX_DRIFT * 1e6, 0, (GParamFlags) (G_PARAM_READABLE |
+              G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_HIGH_WATER_MARK,
+      g_param_spec_uint ("high-water-mark", "High Water Mark",
+          "Most 10ms far end periods waiting for the processor at once",
+          0, G_MAXUINT, 0, (GParamFlags) (G_PARAM_READABLE |
+              G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_OVERFLOW_DROPS,
+      g_param_spec_uint ("overflow-drops", "Overflow Drops",
+          "Number of 10ms far end periods dropped as the processor did not "
+          "take them in time",
+          0, G_MAXUINT, 0, (GParamFlags) (G_PARAM_READABLE |
+              G_PARAM_STATIC_STRINGS)));
+
   gst_element_class_set_static_metadata (element_class,
       "Audio probe",
       "Generic/Audio",
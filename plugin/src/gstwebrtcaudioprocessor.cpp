@@ -34,8 +34,50 @@
  * While webrtcaudioprocessor element can be used alone, there is an exception for the
  * echo canceller. The audio canceller need to be aware of the far end streams
  * that are played to loud speakers. For this, you must place a webrtcaudioprobe
- * element at that far end. Note that the sample rate must match between
- * webrtcaudioprocessor and the webrtaudioprobe. Though, the number of channels can differ.
+ * element at that far end. The probe may run at another sample rate and with
+ * another number of channels than webrtcaudioprocessor, the far end is
+ * resampled to the processor's rate inside the probe.
+ *
+ * Far end is lined up with the near end by timestamps: each capture period
+ * goes to the engine with the far end played at the same clock time, given
+ * the playback latency. The probe's #GstWebrtcAudioProbe:delay only needs
+ * setting for a long acoustic path, or devices reporting a wrong latency.
+ *
+ * Both elements accept interleaved S16 and non-interleaved F32 audio, the
+ * latter being handed to the engine as is through its float entry points.
+ * Any sample rate is accepted: a stream at a rate the engine does not
+ * support, like 44.1 kHz, is processed at the next higher supported rate
+ * and resampled back inside the processor.
+ *
+ * With #GstWebrtcAudioProcessor:voice-detection enabled, the processor posts
+ * a "voice-activity" element message, with "stream-time" and
+ * "stream-has-voice" fields, each time the stream starts or stops carrying
+ * voice. Short bursts and short pauses are ignored, so applications can
+ * stop encoding or forwarding a silent stream on these messages alone.
+ *
+ * #GstWebrtcAudioProcessor:dtx-mode acts on the same decisions inside the
+ * pipeline. In "gap" mode, outputs without voice are zeroed and flagged
+ * with %GST_BUFFER_FLAG_GAP, in "drop" mode they are replaced with gap
+ * events, and encoders and mixers downstream skip them.
+ *
+ * By default the engine runs on the upstream streaming thread, network and
+ * capture threads included. With #GstWebrtcAudioProcessor:async set, input
+ * buffers are instead handed to a thread pool shared by every processor of
+ * the process and sized to its cores. Each processor's buffers are still
+ * processed in order, one at a time, and the outputs are pushed downstream
+ * by a task on the processor's source pad, so a blocked downstream never
+ * holds a pool thread.
+ * The far end needs no thread of its own, the probe only queues it and
+ * the processor feeds it to the engine along with the near end.
+ *
+ * Each webrtcaudioprocessor owns its own processing engine, so any number of
+ * them can run in the same process. When started, a processor pairs with the
+ * webrtcaudioprobe named by its #GstWebrtcAudioProcessor:probe property, or
+ * with the first webrtcaudioprobe not already used by another processor when
+ * the property is unset. Probes in the processor's own pipeline are picked
+ * first. A probe in another pipeline is paired by name only when its name
+ * is unique across the process. Every processor/probe pair shares one
+ * engine and only cancels the echo of its own far end.
  *
  * # Example launch line
  *
@@ -55,6 +97,16 @@
  * gst-launch-1.0 far-end-src ! audio/x-raw,rate=48000 ! webrtcaudioprobe ! pulsesink \
  *                pulsesrc ! audio/x-raw,rate=48000 ! webrtcaudioprocessor ! far-end-sink
  * ]|
+ *
+ * When several sessions share a pipeline, name each probe and point its
+ * processor at it.
+ *
+ * |[
+ * gst-launch-1.0 far-end-src-1 ! webrtcaudioprobe name=probe1 ! sink-1 \
+ *                src-1 ! webrtcaudioprocessor probe=probe1 ! far-end-sink-1 \
+ *                far-end-src-2 ! webrtcaudioprobe name=probe2 ! sink-2 \
+ *                src-2 ! webrtcaudioprocessor probe=probe2 ! far-end-sink-2
+ * ]|
  */
 
 #ifdef HAVE_CONFIG_H
@@ -62,33 +114,15 @@
 #endif
 
 #include <stdbool.h>
+#include <string.h>
 
 #include "gst/webrtcaudioprocessing/gstwebrtcaudioprocessor.h"
 #include "gst/webrtcaudioprocessing/gstwebrtcaudioprobe.h"
-
-#ifdef _WIN32
-  #define SHARED_PUBLIC __declspec(dllimport)
-#else
-  #define SHARED_PUBLIC __attribute__ ((visibility ("default")))
-#endif
-
-// should go in a webrtc.h
-#define kMaxDataSizeSamples 7680
-#define NSL_LOW 0
-#define NSL_MODERATE 1
-#define NSL_HIGH 2
-#define NSL_VERYHIGH 3
-#define LS_VERBOSE 0
-#define LS_INFO 1
-#define LS_WARNING 2
-#define LS_ERROR 3
-#define LS_NONE 4
-extern "C" SHARED_PUBLIC const char* ap_error(int);
-extern "C" SHARED_PUBLIC void ap_setup(int, bool, bool, int, bool, int);
-extern "C" SHARED_PUBLIC void ap_delete();
-extern "C" SHARED_PUBLIC void ap_delay(int);
-extern "C" SHARED_PUBLIC int ap_process_reverse(int, int, int16_t*);
-extern "C" SHARED_PUBLIC int ap_process(int, int, int16_t*);
+#include "gst/webrtcaudioprocessing/gstwebrtcmultiprocessor.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcconvert.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcechocanceller.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcresampler.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcworkers.h"
 
 GST_DEBUG_CATEGORY (webrtc_audio_processor_debug);
 #define GST_CAT_DEFAULT (webrtc_audio_processor_debug)
@@ -96,6 +130,25 @@ GST_DEBUG_CATEGORY (webrtc_audio_processor_debug);
 #define DEFAULT_PROCESSING_RATE 48000
 #define DEFAULT_VOICE_DETECTION FALSE
 #define DEFAULT_GAIN_CONTROLLER FALSE
+#define DEFAULT_PROBE NULL
+#define DEFAULT_IN_PLACE TRUE
+#define DEFAULT_MIN_BUFFERS 4
+#define DEFAULT_MAX_BUFFERS 0
+#define DEFAULT_DTX_MODE DTX_OFF
+#define DEFAULT_ASYNC FALSE
+
+/* Voice detection hysteresis, in 10ms periods */
+#define VAD_ONSET_PERIODS 3
+#define VAD_HANGOVER_PERIODS 20
+#define PERIOD_DURATION (10 * GST_MSECOND)
+
+/* Interleaved periods handed to the engine per call */
+#define MAX_BATCH_PERIODS 10
+
+/* Inputs waiting for a worker, and outputs waiting for the source pad task,
+ * before upstream blocks, in async mode */
+#define ASYNC_MAX_JOBS 4
+#define ASYNC_MAX_OUTPUTS 16
 
 static GstStaticPadTemplate gst_webrtc_audio_processor_sink_template =
 GST_STATIC_PAD_TEMPLATE ("sink",
@@ -104,7 +157,12 @@ GST_STATIC_PAD_TEMPLATE ("sink",
     GST_STATIC_CAPS ("audio/x-raw, "
         "format = (string) " GST_AUDIO_NE (S16) ", "
         "layout = (string) interleaved, "
-        "rate = (int) { 48000, 32000, 16000, 8000 }, "
+        "rate = (int) [ 8000, 192000 ], "
+        "channels = (int) [1, MAX];"
+        "audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (F32) ", "
+        "layout = (string) non-interleaved, "
+        "rate = (int) [ 8000, 192000 ], "
         "channels = (int) [1, MAX]")
     );
 
@@ -115,7 +173,12 @@ GST_STATIC_PAD_TEMPLATE ("src",
     GST_STATIC_CAPS ("audio/x-raw, "
         "format = (string) " GST_AUDIO_NE (S16) ", "
         "layout = (string) interleaved, "
-        "rate = (int) { 48000, 32000, 16000, 8000 }, "
+        "rate = (int) [ 8000, 192000 ], "
+        "channels = (int) [1, MAX];"
+        "audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (F32) ", "
+        "layout = (string) non-interleaved, "
+        "rate = (int) [ 8000, 192000 ], "
         "channels = (int) [1, MAX]")
     );
 
@@ -142,10 +205,36 @@ gst_webrtc_logging_severity_get_type (void)
   return logging_severity_type;
 }
 
-typedef int GstWebrtcAudioProcessingNoiseSuppressionLevel;
-#define GST_TYPE_WEBRTC_NOISE_SUPPRESSION_LEVEL \
-    (gst_webrtc_noise_suppression_level_get_type ())
+enum
+{
+  DTX_OFF,
+  DTX_GAP,
+  DTX_DROP
+};
+
+typedef int GstWebrtcAudioProcessingDtxMode;
+#define GST_TYPE_WEBRTC_DTX_MODE \
+    (gst_webrtc_dtx_mode_get_type ())
 static GType
+gst_webrtc_dtx_mode_get_type (void)
+{
+  static GType dtx_mode_type = 0;
+  static const GEnumValue mode_types[] = {
+    {DTX_OFF, "Output every period", "off"},
+    {DTX_GAP, "Output silent periods as gap buffers", "gap"},
+    {DTX_DROP, "Replace silent periods with gap events", "drop"},
+    {0, NULL, NULL}
+  };
+
+  if (!dtx_mode_type) {
+    dtx_mode_type =
+        g_enum_register_static ("GstWebrtcAudioProcessingDtxMode", mode_types);
+  }
+  return dtx_mode_type;
+}
+
+/* Also used by webrtcmultiprocessor */
+GType
 gst_webrtc_noise_suppression_level_get_type (void)
 {
   static GType suppression_level_type = 0;
@@ -172,13 +261,23 @@ enum
   PROP_ECHO_CANCEL,
   PROP_NOISE_SUPPRESSION,
   PROP_NOISE_SUPPRESSION_LEVEL,
-#ifdef _WAIT_VAD
   PROP_VOICE_DETECTION,
-#endif
   PROP_GAIN_CONTROLLER,
+  PROP_PROBE,
+  PROP_IN_PLACE,
+  PROP_MIN_BUFFERS,
+  PROP_MAX_BUFFERS,
+  PROP_DTX_MODE,
+  PROP_ASYNC,
+};
+
+enum
+{
+  SIGNAL_RECONFIGURED,
+  LAST_SIGNAL
 };
 
-GMutex webrtcaudioprocessing_mutex;
+static guint gst_webrtc_audio_processor_signals[LAST_SIGNAL] = { 0 };
 
 /**
  * GstWebrtcAudioProcessor:
@@ -191,12 +290,99 @@ struct _GstWebrtcAudioProcessor
 
   /* Protected by the object lock */
   GstAudioInfo info;
+  gboolean interleaved;
   guint period_size;
   guint period_samples;
-  gboolean stream_has_voice;
 
   /* Protected by the stream lock */
   GstAdapter *adapter;
+  GstPlanarAudioAdapter *padapter;
+
+  /* Voice detection as last applied to the engine, whether transitions are
+   * posted, the state last reached and the number of periods in a row that
+   * contradicted it */
+  gboolean vad;
+  gboolean vad_messages;
+  gboolean stream_has_voice;
+  guint vad_run;
+
+  /* Discontinuous transmission: dtx is the mode in effect, output_voice is
+   * set when a period processed for the current output had or could start
+   * voice, and pending_voice holds the same for the pending buffer */
+  gint dtx;
+  gboolean output_voice;
+  gboolean pending_voice;
+
+  /* One float plane per channel and period of a batch, interleaved periods
+   * are converted into them and fed to the engine's float entry point */
+  float *scratch;
+  float **scratch_planes;
+
+  /* In place slicing, protected by the stream lock. Whole periods are
+   * processed inside the input buffer, only a trailing partial period is
+   * staged in carry until the next input completes it. */
+  gboolean slice_in_place;
+  GstBuffer *input;
+  GstBuffer *carry;
+  guint carry_fill;
+  GstBuffer *pending;
+
+  /* When the stream rate is not one the engine supports, audio is resampled
+   * to proc_rate, processed, and resampled back. Protected by the stream
+   * lock. Input is converted a chunk at a time into rs_in, batches at
+   * proc_rate pulled into rs_proc, and output into rs_out. rs_pts is the
+   * timestamp of the first input sample since the last discont,
+   * rs_proc_samples the number of samples since pulled from down at
+   * proc_rate, and rs_samples the number output at the stream rate. Both
+   * resamplers put their first output sample on their first input sample,
+   * so those counts time the batches and outputs exactly, however much
+   * audio the filters hold back. */
+  gint proc_rate;
+  guint proc_period_samples;
+  GstWebrtcResampler *down;
+  GstWebrtcResampler *up;
+  float *rs_in;
+  float **rs_in_planes;
+  float *rs_proc;
+  float **rs_proc_planes;
+  float **rs_batch_planes;
+  float *rs_out;
+  float **rs_out_planes;
+  guint rs_out_samples;
+  GstClockTime rs_pts;
+  guint64 rs_proc_samples;
+  guint64 rs_samples;
+
+  /* In asynchronous mode, inputs are queued here and processed by the
+   * shared workers, one job at a time. Their buffers and gap events go to
+   * outputs, which the source pad task pushes downstream. out_busy is set
+   * while it pushes one. async_ret is the first flow error met on either
+   * side, or FLUSHING during a flush. */
+  GstWebrtcWorkerQueue *workers;
+  GMutex out_lock;
+  GCond out_cond;
+  GQueue outputs;
+  gboolean out_flushing;
+  gboolean out_busy;
+  gint async_ret;
+
+  /* The base class' source pad activation, chained up from ours, which
+   * stops the task */
+  GstPadActivateModeFunction src_activate_mode;
+
+  /* Recycles the 10ms buffers we output, set up in decide_allocation, and
+   * the bodies of shared inputs, set up for body_size on the first one */
+  GstBufferPool *pool;
+  GstBufferPool *body_pool;
+  gsize body_size;
+
+  /* Owned between start() and stop() */
+  ap_engine *engine;
+  GstWebrtcAudioProbe *probe;
+
+  /* Set when a processing property changed while the engine runs, applied
+   * by the streaming thread at the next period boundary */
+  gint config_pending;
 
   /* Properties */
   int logging_severity;
@@ -204,15 +390,35 @@ struct _GstWebrtcAudioProcessor
   gboolean echo_cancel;
   gboolean noise_suppression;
   int noise_suppression_level;
-#ifdef _WAIT_VAD
   gboolean voice_detection;
-#endif
   gboolean gain_controller;
+  gchar *probe_name;
+  gboolean in_place;
+  guint min_buffers;
+  guint max_buffers;
+  gint dtx_mode;
+  gboolean async;
 };
 
 G_DEFINE_TYPE (GstWebrtcAudioProcessor, gst_webrtc_audio_processor, GST_TYPE_AUDIO_FILTER);
 
-#ifdef _WAIT_VAD
+/* An input buffer waiting for a worker */
+typedef struct
+{
+  GstBuffer *buffer;
+  gboolean discont;
+} GstWebrtcAudioProcessorJob;
+
+static void
+gst_webrtc_audio_processor_free_job (gpointer data)
+{
+  GstWebrtcAudioProcessorJob *job = (GstWebrtcAudioProcessorJob *) data;
+
+  if (job->buffer)
+    gst_buffer_unref (job->buffer);
+  g_free (job);
+}
+
 static void
 gst_webrtc_vad_post_message (GstWebrtcAudioProcessor *self, GstClockTime timestamp,
     gboolean stream_has_voice)
@@ -234,14 +440,201 @@ gst_webrtc_vad_post_message (GstWebrtcAudioProcessor *self, GstClockTime timesta
   gst_element_post_message (GST_ELEMENT (self),
       gst_message_new_element (GST_OBJECT (self), s));
 }
-#endif
+
+/* Debounces the detector over the periods of the last call: voice has to
+ * last VAD_ONSET_PERIODS in a row to be reported, and silence
+ * VAD_HANGOVER_PERIODS in a row, so pauses between words and isolated
+ * clicks do not toggle the stream. Transitions are stamped with the first
+ * period of the run that caused them. */
+static void
+gst_webrtc_audio_processor_update_vad (GstWebrtcAudioProcessor * self,
+    gint activity, GstClockTime timestamp, guint n_periods)
+{
+  GstClockTime ts, back;
+  gboolean voice;
+  guint p;
+
+  for (p = 0; p < n_periods; p++) {
+    voice = (activity >> p) & 1;
+
+    if (voice || self->stream_has_voice)
+      self->output_voice = TRUE;
+
+    if (voice == self->stream_has_voice) {
+      self->vad_run = 0;
+      continue;
+    }
+
+    if (++self->vad_run < (voice ? VAD_ONSET_PERIODS : VAD_HANGOVER_PERIODS))
+      continue;
+
+    ts = GST_CLOCK_TIME_NONE;
+    if (GST_CLOCK_TIME_IS_VALID (timestamp)) {
+      ts = timestamp + p * PERIOD_DURATION;
+      back = (self->vad_run - 1) * PERIOD_DURATION;
+      ts = ts > back ? ts - back : 0;
+    }
+
+    self->stream_has_voice = voice;
+    self->vad_run = 0;
+
+    if (self->vad_messages)
+      gst_webrtc_vad_post_message (self, ts, voice);
+  }
+}
+
+static void
+gst_webrtc_audio_processor_check_result (GstWebrtcAudioProcessor * self,
+    gint err, GstClockTime timestamp, guint n_periods)
+{
+  if (err < 0) {
+    GST_WARNING_OBJECT (self, "Failed to process audio: %s.",
+        ap_error (self->engine, err));
+  } else if (self->vad) {
+    gst_webrtc_audio_processor_update_vad (self,
+        ap_voice_activity (self->engine), timestamp, n_periods);
+  }
+}
+
+/* Applies processing properties changed since the last period, without
+ * resetting the engine so its convergence state is kept */
+static void
+gst_webrtc_audio_processor_apply_config (GstWebrtcAudioProcessor * self,
+    GstClockTime timestamp)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (self);
+  gboolean echo_cancel, noise_suppression, gain_controller, voice_detection;
+  int noise_suppression_level;
+  gboolean vad;
+
+  GST_OBJECT_LOCK (self);
+  voice_detection = self->voice_detection;
+  self->dtx = self->dtx_mode;
+  echo_cancel = self->echo_cancel;
+  noise_suppression = self->noise_suppression;
+  noise_suppression_level = self->noise_suppression_level;
+  gain_controller = self->gain_controller;
+  g_atomic_int_set (&self->config_pending, FALSE);
+  GST_OBJECT_UNLOCK (self);
+
+  ap_configure(self->engine, echo_cancel, noise_suppression, noise_suppression_level, gain_controller);
+
+  /* Discontinuous transmission needs the detector too */
+  vad = voice_detection || self->dtx != DTX_OFF;
+  self->vad_messages = voice_detection;
+
+  if (vad != self->vad) {
+    ap_voice_detection(self->engine, vad);
+    self->vad = vad;
+    self->stream_has_voice = FALSE;
+    self->vad_run = 0;
+  }
+
+  GST_DEBUG_OBJECT (self, "Applied echo-cancel=%d noise-suppression=%d "
+      "noise-suppression-level=%d gain-controller=%d voice-detection=%d "
+      "dtx-mode=%d", echo_cancel, noise_suppression, noise_suppression_level,
+      gain_controller, voice_detection, self->dtx);
+
+  g_signal_emit (self, gst_webrtc_audio_processor_signals[SIGNAL_RECONFIGURED], 0,
+      gst_segment_to_stream_time (&trans->segment, GST_FORMAT_TIME, timestamp));
+}
+
+/* The clock time a period was captured at, comparable with the probe's
+ * frame stamps even when it lives in another pipeline on the same clock */
+static GstClockTime
+gst_webrtc_audio_processor_clock_time (GstWebrtcAudioProcessor * self,
+    GstClockTime timestamp)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (self);
+  GstClockTime running_time;
+
+  running_time = gst_segment_to_running_time (&trans->segment, GST_FORMAT_TIME,
+      timestamp);
+
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return GST_CLOCK_TIME_NONE;
+
+  return running_time + gst_element_get_base_time (GST_ELEMENT (self));
+}
+
+static inline void
+gst_webrtc_audio_processor_begin_period (GstWebrtcAudioProcessor * self,
+    GstClockTime timestamp, guint n_periods)
+{
+  if (g_atomic_int_get (&self->config_pending))
+    gst_webrtc_audio_processor_apply_config (self, timestamp);
+
+  if (self->probe)
+    gst_webrtc_audio_probe_process_reverse (self->probe,
+        gst_webrtc_audio_processor_clock_time (self, timestamp),
+        self->proc_rate, n_periods);
+}
+
+static GstClockTime
+gst_webrtc_audio_processor_offset_time (GstWebrtcAudioProcessor * self,
+    GstClockTime timestamp, gsize offset)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+    return GST_CLOCK_TIME_NONE;
+
+  return timestamp + gst_util_uint64_scale_int (offset / self->info.bpf,
+      GST_SECOND, self->info.rate);
+}
+
+/* Processes n_periods consecutive interleaved periods in place, handing up
+ * to MAX_BATCH_PERIODS of them to the engine per call. Configuration and
+ * the far end signal are brought up to date before each batch. */
+static void
+gst_webrtc_audio_processor_process_periods (GstWebrtcAudioProcessor * self,
+    int16_t * data, guint n_periods, GstClockTime timestamp)
+{
+  guint channels = self->info.channels;
+  guint samples = self->period_samples * channels;
+  guint done, n, p;
+  GstClockTime ts;
+  gint err;
+
+  for (done = 0; done < n_periods; done += n) {
+    n = MIN (n_periods - done, MAX_BATCH_PERIODS);
+    ts = gst_webrtc_audio_processor_offset_time (self, timestamp,
+        (gsize) done * self->period_size);
+
+    gst_webrtc_audio_processor_begin_period (self, ts, n);
+
+    for (p = 0; p < n; p++)
+      gst_webrtc_deinterleave_s16 (data + (done + p) * samples,
+          self->scratch_planes + p * channels, channels, self->period_samples);
+
+    err = ap_process_float_batch(self->engine, self->info.rate, channels, n, self->scratch_planes);
+
+    if (err >= 0) {
+      for (p = 0; p < n; p++)
+        gst_webrtc_interleave_s16 (self->scratch_planes + p * channels,
+            data + (done + p) * samples, channels, self->period_samples);
+    }
+
+    gst_webrtc_audio_processor_check_result (self, err, ts, n);
+  }
+}
+
+static void
+gst_webrtc_audio_processor_process_period_float (GstWebrtcAudioProcessor * self,
+    float * const * planes, GstClockTime timestamp)
+{
+  gint err;
+
+  gst_webrtc_audio_processor_begin_period (self, timestamp, 1);
+
+  err = ap_process_float(self->engine, self->info.rate, self->info.channels, planes);
+
+  gst_webrtc_audio_processor_check_result (self, err, timestamp, 1);
+}
 
 static GstFlowReturn
 gst_webrtc_audio_processor_process_stream (GstWebrtcAudioProcessor * self,
     GstBuffer * buffer)
 {
   GstAudioBuffer abuf;
-  gint err;
 
   if (!gst_audio_buffer_map (&abuf, &self->info, buffer,
           (GstMapFlags) GST_MAP_READWRITE)) {
@@ -249,57 +642,477 @@ gst_webrtc_audio_processor_process_stream (GstWebrtcAudioProcessor * self,
     return GST_FLOW_ERROR;
   }
 
-  int16_t * const data = (int16_t * const) abuf.planes[0];
-  
-  err = ap_process(self->info.rate, self->info.channels, data);
+  if (self->interleaved)
+    gst_webrtc_audio_processor_process_periods (self,
+        (int16_t *) abuf.planes[0], 1, GST_BUFFER_PTS (buffer));
+  else
+    gst_webrtc_audio_processor_process_period_float (self,
+        (float * const *) abuf.planes, GST_BUFFER_PTS (buffer));
 
-  if (err < 0) {
-    GST_WARNING_OBJECT (self, "Failed to process audio: %s.",
-        ap_error (err));
-  } else {
-#ifdef _WAIT_VAD
-    if (self->voice_detection) {
-      gboolean stream_has_voice = apm->voice_detection ()->stream_has_voice ();
+  gst_audio_buffer_unmap (&abuf);
+
+  return GST_FLOW_OK;
+}
+
+static GstBufferPool *gst_webrtc_audio_processor_new_pool (GstWebrtcAudioProcessor * self,
+    GstCaps * caps, gsize size, GstAllocator * allocator,
+    GstAllocationParams * params);
+
+static void
+gst_webrtc_audio_processor_free_pool (GstBufferPool ** pool)
+{
+  if (*pool) {
+    gst_buffer_pool_set_active (*pool, FALSE);
+    gst_object_unref (*pool);
+    *pool = NULL;
+  }
+}
+
+/* Returns the pool of size buffers for the bodies of shared inputs, set up
+ * like the period pool. Upstream keeps to one buffer size in practice, so
+ * it is only replaced when that changes. */
+static GstBufferPool *
+gst_webrtc_audio_processor_get_body_pool (GstWebrtcAudioProcessor * self,
+    gsize size)
+{
+  GstStructure *config;
+  GstCaps *caps = NULL;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+
+  if (self->body_size == size)
+    return self->body_pool;
+
+  gst_webrtc_audio_processor_free_pool (&self->body_pool);
+
+  config = gst_buffer_pool_get_config (self->pool);
+  gst_buffer_pool_config_get_params (config, &caps, NULL, NULL, NULL);
+  gst_allocation_params_init (&params);
+  gst_buffer_pool_config_get_allocator (config, &allocator, &params);
+
+  self->body_pool = gst_webrtc_audio_processor_new_pool (self, caps, size,
+      allocator, &params);
+  gst_structure_free (config);
+
+  if (self->body_pool && !gst_buffer_pool_set_active (self->body_pool, TRUE))
+    gst_webrtc_audio_processor_free_pool (&self->body_pool);
+
+  if (!self->body_pool)
+    GST_WARNING_OBJECT (self, "Could not set up a pool for %" G_GSIZE_FORMAT
+        " byte buffers.", size);
+
+  self->body_size = size;
+
+  return self->body_pool;
+}
+
+static GstBuffer *
+gst_webrtc_audio_processor_alloc_output (GstWebrtcAudioProcessor * self,
+    gsize size)
+{
+  GstBufferPoolAcquireParams params = { GST_FORMAT_UNDEFINED, 0, 0,
+    GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT };
+  GstBufferPool *pool = NULL;
+  GstBuffer *buffer = NULL;
+
+  if (self->pool && size == self->period_size)
+    pool = self->pool;
+  else if (self->pool && size % self->period_size == 0)
+    pool = gst_webrtc_audio_processor_get_body_pool (self, size);
+
+  /* Never wait on the pool, when every buffer is still held downstream
+   * allocate one outside of it */
+  if (pool &&
+      gst_buffer_pool_acquire_buffer (pool, &buffer, &params) == GST_FLOW_OK)
+    return buffer;
+
+  return gst_buffer_new_allocate (NULL, size, NULL);
+}
+
+/* Returns the period buffer staging the carry, taking a new one from the
+ * pool when the previous one went downstream */
+static GstBuffer *
+gst_webrtc_audio_processor_get_carry (GstWebrtcAudioProcessor * self)
+{
+  if (!self->carry)
+    self->carry = gst_webrtc_audio_processor_alloc_output (self, self->period_size);
+
+  return self->carry;
+}
+
+static void
+gst_webrtc_audio_processor_clear_slices (GstWebrtcAudioProcessor * self)
+{
+  gst_buffer_replace (&self->input, NULL);
+  gst_buffer_replace (&self->pending, NULL);
+  self->carry_fill = 0;
+}
+
+/* Processes the whole periods of a shared input into a new buffer, copying
+ * each batch once right before handing it to the engine */
+static GstBuffer *
+gst_webrtc_audio_processor_process_copy (GstWebrtcAudioProcessor * self,
+    GstBuffer * input, const guint8 * data, gsize offset, gsize size)
+{
+  GstBuffer *body = gst_webrtc_audio_processor_alloc_output (self, size);
+  GstClockTime pts = GST_BUFFER_PTS (input);
+  gsize batch = (gsize) MAX_BATCH_PERIODS * self->period_size;
+  GstMapInfo map;
+  gsize o, n;
+
+  gst_buffer_copy_into (body, input, (GstBufferCopyFlags) (GST_BUFFER_COPY_FLAGS |
+          GST_BUFFER_COPY_META), 0, -1);
+
+  gst_buffer_map (body, &map, GST_MAP_WRITE);
+
+  for (o = 0; o < size; o += n) {
+    n = MIN (size - o, batch);
+    memcpy (map.data + o, data + offset + o, n);
+    gst_webrtc_audio_processor_process_periods (self, (int16_t *) (map.data + o),
+        n / self->period_size,
+        gst_webrtc_audio_processor_offset_time (self, pts, offset + o));
+  }
+
+  gst_buffer_unmap (body, &map);
+
+  return body;
+}
+
+static GstFlowReturn
+gst_webrtc_audio_processor_generate_in_place (GstWebrtcAudioProcessor * self,
+    GstBuffer ** outbuf)
+{
+  GstBuffer *input = self->input;
+  GstBuffer *completed = NULL;
+  GstBuffer *body = NULL;
+  GstClockTime pts;
+  GstMapInfo map;
+  gboolean writable;
+  gsize offset = 0, whole, tail;
+
+  *outbuf = NULL;
+
+  /* The body of the previous input, queued behind a completed carry */
+  if (self->pending) {
+    *outbuf = self->pending;
+    self->pending = NULL;
+    return GST_FLOW_OK;
+  }
+
+  if (!input)
+    return GST_FLOW_OK;
+
+  self->input = NULL;
+  pts = GST_BUFFER_PTS (input);
+
+  /* A shared input (tee, queue holding a ref) is left untouched and only
+   * read, the processed audio then goes to a separate output buffer */
+  writable = gst_buffer_is_writable (input);
+
+  if (!gst_buffer_map (input, &map,
+          writable ? GST_MAP_READWRITE : GST_MAP_READ)) {
+    gst_buffer_unref (input);
+    return GST_FLOW_ERROR;
+  }
+
+  if (self->carry_fill > 0) {
+    offset = MIN (self->period_size - self->carry_fill, map.size);
+    gst_buffer_fill (self->carry, self->carry_fill, map.data, offset);
+    self->carry_fill += offset;
+
+    if (self->carry_fill == self->period_size) {
+      GstMapInfo cmap;
 
-      if (stream_has_voice != self->stream_has_voice)
-        gst_webrtc_vad_post_message (self, GST_BUFFER_PTS (buffer), stream_has_voice);
+      gst_buffer_map (self->carry, &cmap, GST_MAP_READWRITE);
+      gst_webrtc_audio_processor_process_periods (self,
+          (int16_t *) cmap.data, 1, GST_BUFFER_PTS (self->carry));
+      gst_buffer_unmap (self->carry, &cmap);
 
-      self->stream_has_voice = stream_has_voice;
+      completed = self->carry;
+      self->carry = NULL;
+      self->carry_fill = 0;
     }
-#endif
   }
 
-  gst_audio_buffer_unmap (&abuf);
+  whole = (map.size - offset) / self->period_size * self->period_size;
+  tail = map.size - offset - whole;
+
+  if (whole > 0 && !writable) {
+    body = gst_webrtc_audio_processor_process_copy (self, input, map.data,
+        offset, whole);
+  } else if (whole > 0) {
+    gst_webrtc_audio_processor_process_periods (self,
+        (int16_t *) (map.data + offset), whole / self->period_size,
+        gst_webrtc_audio_processor_offset_time (self, pts, offset));
+  }
+
+  if (tail > 0) {
+    GstBuffer *carry = gst_webrtc_audio_processor_get_carry (self);
+
+    gst_buffer_fill (carry, 0, map.data + offset + whole, tail);
+    GST_BUFFER_PTS (carry) =
+        gst_webrtc_audio_processor_offset_time (self, pts, offset + whole);
+    GST_BUFFER_DURATION (carry) =
+        gst_util_uint64_scale_int (self->period_samples, GST_SECOND, self->info.rate);
+    self->carry_fill = tail;
+  }
+
+  gst_buffer_unmap (input, &map);
+
+  if (whole > 0 && !body) {
+    if (whole == map.size) {
+      body = input;
+      input = NULL;
+    } else {
+      /* Shares the input memory, no copy */
+      body = gst_buffer_copy_region (input, GST_BUFFER_COPY_ALL, offset, whole);
+    }
+  }
+
+  if (body) {
+    GST_BUFFER_PTS (body) =
+        gst_webrtc_audio_processor_offset_time (self, pts, offset);
+    GST_BUFFER_DURATION (body) = gst_util_uint64_scale_int (
+        whole / self->info.bpf, GST_SECOND, self->info.rate);
+  }
+
+  if (input)
+    gst_buffer_unref (input);
+
+  if (completed) {
+    *outbuf = completed;
+    self->pending = body;
+  } else
+    *outbuf = body;
 
   return GST_FLOW_OK;
 }
 
+/* Queues what waits in the adapters in the down resampler, a period at the
+ * stream rate at a time, until it holds a batch */
+static void
+gst_webrtc_audio_processor_feed_resampler (GstWebrtcAudioProcessor * self)
+{
+  guint channels = self->info.channels;
+  guint bpf = self->info.bpf;
+  GstAudioBuffer abuf;
+  GstBuffer *buffer;
+  GstClockTime pts;
+  guint64 distance;
+  const guint8 *data;
+  gboolean queued;
+  guint n;
+
+  for (;;) {
+    if (gst_webrtc_resampler_available (self->down) >=
+        MAX_BATCH_PERIODS * self->proc_period_samples)
+      break;
+
+    if (self->interleaved)
+      n = MIN (gst_adapter_available (self->adapter) / bpf, self->period_samples);
+    else
+      n = MIN (gst_planar_audio_adapter_available (self->padapter),
+          self->period_samples);
+
+    if (n == 0)
+      break;
+
+    if (!GST_CLOCK_TIME_IS_VALID (self->rs_pts)) {
+      if (self->interleaved) {
+        pts = gst_adapter_prev_pts (self->adapter, &distance);
+        self->rs_pts = gst_webrtc_audio_processor_offset_time (self, pts, distance);
+      } else {
+        pts = gst_planar_audio_adapter_prev_pts (self->padapter, &distance);
+        self->rs_pts = GST_CLOCK_TIME_IS_VALID (pts) ?
+            pts + gst_util_uint64_scale_int (distance, GST_SECOND, self->info.rate) :
+            GST_CLOCK_TIME_NONE;
+      }
+      self->rs_proc_samples = 0;
+      self->rs_samples = 0;
+    }
+
+    if (self->interleaved) {
+      data = (const guint8 *) gst_adapter_map (self->adapter, n * bpf);
+      gst_webrtc_deinterleave_s16 ((const gint16 *) data, self->rs_in_planes,
+          channels, n);
+      gst_adapter_unmap (self->adapter);
+      gst_adapter_flush (self->adapter, n * bpf);
+
+      queued = gst_webrtc_resampler_push (self->down,
+          (const float * const *) self->rs_in_planes, n);
+    } else {
+      buffer = gst_planar_audio_adapter_take_buffer (self->padapter, n,
+          GST_MAP_READ);
+      gst_audio_buffer_map (&abuf, &self->info, buffer, GST_MAP_READ);
+
+      queued = gst_webrtc_resampler_push (self->down,
+          (const float * const *) abuf.planes, n);
+
+      gst_audio_buffer_unmap (&abuf);
+      gst_buffer_unref (buffer);
+    }
+
+    if (!queued)
+      GST_WARNING_OBJECT (self, "Resampler queue full, dropped input.");
+  }
+}
+
+/* Processes a batch of periods at proc_rate out of the down resampler, and
+ * outputs whatever the up resampler then has at the stream rate */
 static GstFlowReturn
-gst_webrtc_audio_processor_submit_input_buffer (GstBaseTransform * btrans,
-    gboolean is_discont, GstBuffer * buffer)
+gst_webrtc_audio_processor_generate_resampled (GstWebrtcAudioProcessor * self,
+    GstBuffer ** outbuf)
 {
-  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+  guint channels = self->info.channels;
+  GstAudioBuffer abuf;
+  GstClockTime ts;
+  guint n, count;
+  gint err;
+
+  *outbuf = NULL;
+
+  gst_webrtc_audio_processor_feed_resampler (self);
+
+  n = MIN (gst_webrtc_resampler_available (self->down) /
+      self->proc_period_samples, MAX_BATCH_PERIODS);
+
+  if (n == 0)
+    return GST_FLOW_OK;
+
+  /* Capture time of the batch, from the input side: the up resampler may
+   * still hold back part of the previous batches */
+  ts = GST_CLOCK_TIME_IS_VALID (self->rs_pts) ? self->rs_pts +
+      gst_util_uint64_scale_int (self->rs_proc_samples, GST_SECOND, self->proc_rate) :
+      GST_CLOCK_TIME_NONE;
+
+  gst_webrtc_resampler_pull (self->down, self->rs_proc_planes,
+      n * self->proc_period_samples);
+  self->rs_proc_samples += n * self->proc_period_samples;
+
+  gst_webrtc_audio_processor_begin_period (self, ts, n);
+
+  err = ap_process_float_batch(self->engine, self->proc_rate, channels, n, self->rs_batch_planes);
+
+  gst_webrtc_audio_processor_check_result (self, err, ts, n);
+
+  gst_webrtc_resampler_push (self->up, (const float * const *) self->rs_proc_planes,
+      n * self->proc_period_samples);
+
+  count = MIN (gst_webrtc_resampler_available (self->up), self->rs_out_samples);
+
+  if (count == 0)
+    return GST_FLOW_OK;
+
+  if (self->interleaved)
+    *outbuf = gst_webrtc_audio_processor_alloc_output (self, count * self->info.bpf);
+  else {
+    *outbuf = gst_buffer_new_allocate (NULL, count * self->info.bpf, NULL);
+    gst_buffer_add_audio_meta (*outbuf, &self->info, count, NULL);
+  }
+
+  gst_audio_buffer_map (&abuf, &self->info, *outbuf, GST_MAP_WRITE);
 
-  buffer = gst_buffer_make_writable (buffer);
+  if (self->interleaved) {
+    gst_webrtc_resampler_pull (self->up, self->rs_out_planes, count);
+    gst_webrtc_interleave_s16 ((const float * const *) self->rs_out_planes,
+        (gint16 *) abuf.planes[0], channels, count);
+  } else
+    gst_webrtc_resampler_pull (self->up, (float * const *) abuf.planes, count);
 
+  gst_audio_buffer_unmap (&abuf);
+
+  GST_BUFFER_PTS (*outbuf) = GST_CLOCK_TIME_IS_VALID (self->rs_pts) ?
+      self->rs_pts + gst_util_uint64_scale_int (self->rs_samples, GST_SECOND,
+          self->info.rate) : GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DURATION (*outbuf) =
+      gst_util_uint64_scale_int (count, GST_SECOND, self->info.rate);
+  self->rs_samples += count;
+
+  return GST_FLOW_OK;
+}
+
+static void
+gst_webrtc_audio_processor_reset_resampling (GstWebrtcAudioProcessor * self)
+{
+  if (!self->down)
+    return;
+
+  gst_webrtc_resampler_reset (self->down);
+  gst_webrtc_resampler_reset (self->up);
+  self->rs_pts = GST_CLOCK_TIME_NONE;
+  self->rs_proc_samples = 0;
+  self->rs_samples = 0;
+}
+
+static GstFlowReturn
+gst_webrtc_audio_processor_queue_input (GstWebrtcAudioProcessor * self,
+    gboolean is_discont, GstBuffer * buffer)
+{
+  /* No gst_buffer_make_writable() here, a shared buffer would be deep copied
+   * up front. Each mode only copies the periods it cannot process in place. */
   if (is_discont) {
     GST_DEBUG_OBJECT (self,
         "Received discont, clearing adapter.");
     gst_adapter_clear (self->adapter);
+    gst_planar_audio_adapter_clear (self->padapter);
+    self->carry_fill = 0;
+    gst_webrtc_audio_processor_reset_resampling (self);
+  }
+
+  if (self->slice_in_place) {
+    gst_buffer_replace (&self->input, NULL);
+    self->input = buffer;
+    return GST_FLOW_OK;
   }
 
-  gst_adapter_push (self->adapter, buffer);
+  if (self->interleaved)
+    gst_adapter_push (self->adapter, buffer);
+  else
+    gst_planar_audio_adapter_push (self->padapter, buffer);
 
   return GST_FLOW_OK;
 }
 
 static GstFlowReturn
-gst_webrtc_audio_processor_generate_output (GstBaseTransform * btrans, GstBuffer ** outbuf)
+gst_webrtc_audio_processor_generate (GstWebrtcAudioProcessor * self,
+    GstBuffer ** outbuf)
 {
-  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
   GstFlowReturn ret;
+  GstClockTime pts;
+  guint64 distance;
+  GstMapInfo map;
   gboolean not_enough;
 
+  if (self->down)
+    return gst_webrtc_audio_processor_generate_resampled (self, outbuf);
+
+  if (self->slice_in_place)
+    return gst_webrtc_audio_processor_generate_in_place (self, outbuf);
+
+  if (!self->interleaved) {
+    if (gst_planar_audio_adapter_available (self->padapter) < self->period_samples) {
+      *outbuf = NULL;
+      return GST_FLOW_OK;
+    }
+
+    pts = gst_planar_audio_adapter_prev_pts (self->padapter, &distance);
+
+    /* Planes of a single input buffer are shared, not copied */
+    *outbuf = gst_planar_audio_adapter_take_buffer (self->padapter,
+        self->period_samples, GST_MAP_READWRITE);
+
+    GST_BUFFER_PTS (*outbuf) = GST_CLOCK_TIME_IS_VALID (pts) ?
+        pts + gst_util_uint64_scale_int (distance, GST_SECOND, self->info.rate) :
+        GST_CLOCK_TIME_NONE;
+
+    ret = gst_webrtc_audio_processor_process_stream (self, *outbuf);
+
+    if (ret != GST_FLOW_OK)
+      *outbuf = NULL;
+
+    return ret;
+  }
+
   not_enough = gst_adapter_available (self->adapter) < self->period_size;
 
   if (not_enough) {
@@ -307,24 +1120,551 @@ gst_webrtc_audio_processor_generate_output (GstBaseTransform * btrans, GstBuffer
     return GST_FLOW_OK;
   }
 
-  *outbuf = gst_adapter_take_buffer (self->adapter, self->period_size);
+  pts = gst_adapter_prev_pts (self->adapter, &distance);
+
+  *outbuf = gst_webrtc_audio_processor_alloc_output (self, self->period_size);
+  gst_buffer_map (*outbuf, &map, GST_MAP_WRITE);
+  gst_adapter_copy (self->adapter, map.data, 0, self->period_size);
+  gst_buffer_unmap (*outbuf, &map);
+  gst_adapter_flush (self->adapter, self->period_size);
+
+  GST_BUFFER_PTS (*outbuf) =
+      gst_webrtc_audio_processor_offset_time (self, pts, distance);
+  GST_BUFFER_DURATION (*outbuf) =
+      gst_util_uint64_scale_int (self->period_samples, GST_SECOND, self->info.rate);
+
   ret = gst_webrtc_audio_processor_process_stream (self, *outbuf);
 
+  if (ret != GST_FLOW_OK)
+    *outbuf = NULL;
+
+  return ret;
+}
+
+/* Hands a buffer or an event over to the source pad task, in async mode */
+static void
+gst_webrtc_audio_processor_queue_output (GstWebrtcAudioProcessor * self,
+    GstMiniObject * item)
+{
+  g_mutex_lock (&self->out_lock);
+  if (self->out_flushing) {
+    gst_mini_object_unref (item);
+  } else {
+    g_queue_push_tail (&self->outputs, item);
+    g_cond_broadcast (&self->out_cond);
+  }
+  g_mutex_unlock (&self->out_lock);
+}
+
+static void
+gst_webrtc_audio_processor_clear_outputs (GstWebrtcAudioProcessor * self)
+{
+  GstMiniObject *item;
+
+  g_mutex_lock (&self->out_lock);
+  while ((item = (GstMiniObject *) g_queue_pop_head (&self->outputs)))
+    gst_mini_object_unref (item);
+  g_cond_broadcast (&self->out_cond);
+  g_mutex_unlock (&self->out_lock);
+}
+
+static void
+gst_webrtc_audio_processor_set_out_flushing (GstWebrtcAudioProcessor * self,
+    gboolean flushing)
+{
+  g_mutex_lock (&self->out_lock);
+  self->out_flushing = flushing;
+  g_cond_broadcast (&self->out_cond);
+  g_mutex_unlock (&self->out_lock);
+}
+
+/* Turns an output without voice into silence flagged as a gap, or drops it
+ * and tells downstream about the hole with a gap event. Returns FALSE when
+ * the buffer was dropped. */
+static gboolean
+gst_webrtc_audio_processor_apply_dtx (GstWebrtcAudioProcessor * self,
+    GstBuffer ** outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (self);
+  GstClockTime pts = GST_BUFFER_PTS (*outbuf);
+  GstClockTime duration = GST_BUFFER_DURATION (*outbuf);
+
+  if (self->dtx == DTX_GAP) {
+    *outbuf = gst_buffer_make_writable (*outbuf);
+    gst_buffer_memset (*outbuf, 0, 0, gst_buffer_get_size (*outbuf));
+    GST_BUFFER_FLAG_SET (*outbuf, GST_BUFFER_FLAG_GAP);
+    return TRUE;
+  }
+
+  gst_buffer_unref (*outbuf);
+  *outbuf = NULL;
+
+  if (!GST_CLOCK_TIME_IS_VALID (pts))
+    return FALSE;
+
+  if (self->workers)
+    gst_webrtc_audio_processor_queue_output (self,
+        GST_MINI_OBJECT_CAST (gst_event_new_gap (pts, duration)));
+  else
+    gst_pad_push_event (GST_BASE_TRANSFORM_SRC_PAD (trans),
+        gst_event_new_gap (pts, duration));
+
+  return FALSE;
+}
+
+static GstFlowReturn
+gst_webrtc_audio_processor_next_output (GstWebrtcAudioProcessor * self,
+    GstBuffer ** outbuf)
+{
+  GstFlowReturn ret;
+  gboolean voice, from_pending;
+
+  /* A dropped output must not end the base class' loop, which would leave
+   * the rest of the input waiting for the next buffer */
+  do {
+    from_pending = self->pending != NULL;
+    self->output_voice = self->stream_has_voice;
+
+    ret = gst_webrtc_audio_processor_generate (self, outbuf);
+
+    if (ret != GST_FLOW_OK || !*outbuf || self->dtx == DTX_OFF)
+      return ret;
+
+    /* A pending buffer was processed by the call that queued it */
+    voice = from_pending ? self->pending_voice : self->output_voice;
+    if (self->pending && !from_pending)
+      self->pending_voice = self->output_voice;
+  } while (!voice && !gst_webrtc_audio_processor_apply_dtx (self, outbuf));
+
   return ret;
 }
 
+/* Runs on a pool thread: what the base class does on the streaming thread
+ * in synchronous mode, minus the pushing, which would tie the pool thread
+ * to downstream */
+static void
+gst_webrtc_audio_processor_run_job (gpointer data, gpointer user_data)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (user_data);
+  GstWebrtcAudioProcessorJob *job = (GstWebrtcAudioProcessorJob *) data;
+  GstBuffer *outbuf;
+  GstFlowReturn ret;
+
+  if (g_atomic_int_get (&self->async_ret) != GST_FLOW_OK) {
+    gst_webrtc_audio_processor_free_job (job);
+    return;
+  }
+
+  ret = gst_webrtc_audio_processor_queue_input (self, job->discont, job->buffer);
+  job->buffer = NULL;
+  gst_webrtc_audio_processor_free_job (job);
+
+  while (ret == GST_FLOW_OK) {
+    ret = gst_webrtc_audio_processor_next_output (self, &outbuf);
+    if (ret != GST_FLOW_OK || !outbuf)
+      break;
+
+    gst_webrtc_audio_processor_queue_output (self, GST_MINI_OBJECT_CAST (outbuf));
+  }
+
+  /* Returned to upstream on its next buffer */
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "Worker stopped: %s", gst_flow_get_name (ret));
+    g_atomic_int_compare_and_exchange (&self->async_ret, GST_FLOW_OK, ret);
+  }
+}
+
+/* The source pad task, pushes what the workers produced */
+static void
+gst_webrtc_audio_processor_push_loop (gpointer user_data)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (user_data);
+  GstPad *srcpad = GST_BASE_TRANSFORM_SRC_PAD (self);
+  GstMiniObject *item;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&self->out_lock);
+  while (!self->out_flushing && g_queue_is_empty (&self->outputs))
+    g_cond_wait (&self->out_cond, &self->out_lock);
+
+  if (self->out_flushing) {
+    g_mutex_unlock (&self->out_lock);
+    gst_pad_pause_task (srcpad);
+    return;
+  }
+
+  item = (GstMiniObject *) g_queue_pop_head (&self->outputs);
+  self->out_busy = TRUE;
+  g_mutex_unlock (&self->out_lock);
+
+  if (GST_IS_BUFFER (item))
+    ret = gst_pad_push (srcpad, GST_BUFFER_CAST (item));
+  else
+    gst_pad_push_event (srcpad, GST_EVENT_CAST (item));
+
+  /* Returned to upstream on its next buffer, the following outputs still
+   * being taken so that nobody waits on them */
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "Push failed: %s", gst_flow_get_name (ret));
+    g_atomic_int_compare_and_exchange (&self->async_ret, GST_FLOW_OK, ret);
+  }
+
+  g_mutex_lock (&self->out_lock);
+  self->out_busy = FALSE;
+  g_cond_broadcast (&self->out_cond);
+  g_mutex_unlock (&self->out_lock);
+}
+
+/* Waits until everything queued so far was processed and pushed */
+static void
+gst_webrtc_audio_processor_drain (GstWebrtcAudioProcessor * self)
+{
+  gst_webrtc_worker_queue_drain (self->workers);
+
+  g_mutex_lock (&self->out_lock);
+  while (!self->out_flushing &&
+      (self->out_busy || !g_queue_is_empty (&self->outputs)))
+    g_cond_wait (&self->out_cond, &self->out_lock);
+  g_mutex_unlock (&self->out_lock);
+}
+
+static GstFlowReturn
+gst_webrtc_audio_processor_submit_input_buffer (GstBaseTransform * btrans,
+    gboolean is_discont, GstBuffer * buffer)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+  GstWebrtcAudioProcessorJob *job;
+  GstFlowReturn ret;
+
+  if (!self->workers)
+    return gst_webrtc_audio_processor_queue_input (self, is_discont, buffer);
+
+  /* Downstream sets the pace, through the source pad task */
+  g_mutex_lock (&self->out_lock);
+  while (!self->out_flushing &&
+      g_queue_get_length (&self->outputs) >= ASYNC_MAX_OUTPUTS &&
+      g_atomic_int_get (&self->async_ret) == GST_FLOW_OK)
+    g_cond_wait (&self->out_cond, &self->out_lock);
+  g_mutex_unlock (&self->out_lock);
+
+  ret = (GstFlowReturn) g_atomic_int_get (&self->async_ret);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  job = g_new (GstWebrtcAudioProcessorJob, 1);
+  job->buffer = buffer;
+  job->discont = is_discont;
+
+  if (!gst_webrtc_worker_queue_push (self->workers, job)) {
+    gst_webrtc_audio_processor_free_job (job);
+    return GST_FLOW_FLUSHING;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_webrtc_audio_processor_generate_output (GstBaseTransform * btrans, GstBuffer ** outbuf)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+
+  /* The source pad task pushes the workers' outputs */
+  if (self->workers) {
+    *outbuf = NULL;
+    return GST_FLOW_OK;
+  }
+
+  return gst_webrtc_audio_processor_next_output (self, outbuf);
+}
+
+static gboolean
+gst_webrtc_audio_processor_sink_event (GstBaseTransform * btrans, GstEvent * event)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+  GstPad *srcpad = GST_BASE_TRANSFORM_SRC_PAD (btrans);
+  gboolean res;
+
+  if (!self->workers)
+    return GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_processor_parent_class)->sink_event (btrans, event);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      /* Forwarded first, to unblock a push of the source pad task */
+      res = GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_processor_parent_class)->sink_event (btrans, event);
+      gst_webrtc_worker_queue_set_flushing (self->workers, TRUE);
+      g_atomic_int_set (&self->async_ret, GST_FLOW_FLUSHING);
+      gst_webrtc_audio_processor_set_out_flushing (self, TRUE);
+      gst_pad_pause_task (srcpad);
+      return res;
+    case GST_EVENT_FLUSH_STOP:
+      gst_webrtc_worker_queue_drain (self->workers);
+      gst_webrtc_worker_queue_set_flushing (self->workers, FALSE);
+      gst_webrtc_audio_processor_clear_outputs (self);
+      gst_webrtc_audio_processor_set_out_flushing (self, FALSE);
+      g_atomic_int_set (&self->async_ret, GST_FLOW_OK);
+      res = GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_processor_parent_class)->sink_event (btrans, event);
+      gst_pad_start_task (srcpad, gst_webrtc_audio_processor_push_loop,
+          self, NULL);
+      return res;
+    default:
+      /* Serialized events must stay behind the buffers queued before
+       * them, and caps or segments must not change under a job */
+      if (GST_EVENT_IS_SERIALIZED (event))
+        gst_webrtc_audio_processor_drain (self);
+      break;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_processor_parent_class)->sink_event (btrans, event);
+}
+
+static GstBufferPool *
+gst_webrtc_audio_processor_new_pool (GstWebrtcAudioProcessor * self,
+    GstCaps * caps, gsize size, GstAllocator * allocator,
+    GstAllocationParams * params)
+{
+  GstBufferPool *pool = gst_buffer_pool_new ();
+  GstStructure *config = gst_buffer_pool_get_config (pool);
+
+  GST_OBJECT_LOCK (self);
+  gst_buffer_pool_config_set_params (config, caps, size,
+      self->min_buffers, self->max_buffers);
+  GST_OBJECT_UNLOCK (self);
+  gst_buffer_pool_config_set_allocator (config, allocator, params);
+
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    gst_object_unref (pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
+static gboolean
+gst_webrtc_audio_processor_decide_allocation (GstBaseTransform * btrans,
+    GstQuery * query)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstBufferPool *pool;
+  GstCaps *caps;
+
+  if (!GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_processor_parent_class)->decide_allocation (btrans, query))
+    return FALSE;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+  gst_allocation_params_init (&params);
+
+  if (gst_query_get_n_allocation_params (query) > 0)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+
+  pool = gst_webrtc_audio_processor_new_pool (self, caps, self->period_size,
+      allocator, &params);
+
+  if (allocator)
+    gst_object_unref (allocator);
+
+  if (pool && !gst_buffer_pool_set_active (pool, TRUE)) {
+    gst_object_unref (pool);
+    pool = NULL;
+  }
+
+  if (!pool)
+    GST_WARNING_OBJECT (self, "Could not set up the output buffer pool.");
+
+  gst_webrtc_audio_processor_free_pool (&self->pool);
+  gst_webrtc_audio_processor_free_pool (&self->body_pool);
+  self->body_size = 0;
+  self->pool = pool;
+
+  return TRUE;
+}
+
+/* Asks upstream for 10ms buffers, which in place slicing processes without
+ * any copy or carry */
+static gboolean
+gst_webrtc_audio_processor_propose_allocation (GstBaseTransform * btrans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+  GstBufferPool *pool;
+  GstCaps *caps;
+  guint min_buffers, max_buffers;
+
+  if (!GST_BASE_TRANSFORM_CLASS (gst_webrtc_audio_processor_parent_class)->propose_allocation (btrans, decide_query, query))
+    return FALSE;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  if (!caps || gst_query_get_n_allocation_pools (query) > 0 || self->period_size == 0)
+    return TRUE;
+
+  pool = gst_webrtc_audio_processor_new_pool (self, caps, self->period_size,
+      NULL, NULL);
+
+  if (pool) {
+    GST_OBJECT_LOCK (self);
+    min_buffers = self->min_buffers;
+    max_buffers = self->max_buffers;
+    GST_OBJECT_UNLOCK (self);
+
+    gst_query_add_allocation_pool (query, pool, self->period_size,
+        min_buffers, max_buffers);
+    gst_object_unref (pool);
+  }
+
+  return TRUE;
+}
+
 static gboolean
 gst_webrtc_audio_processor_start (GstBaseTransform * btrans)
 {
   GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
+  gchar *probe_name;
 
   GST_OBJECT_LOCK (self);
-  ap_setup(self->processing_rate, self->echo_cancel, self->noise_suppression, self->noise_suppression_level, self->gain_controller, self->logging_severity);
+  self->engine = ap_setup(self->processing_rate, self->echo_cancel, self->noise_suppression, self->noise_suppression_level, self->gain_controller, self->logging_severity);
+  self->dtx = self->dtx_mode;
+  self->vad_messages = self->voice_detection;
+  self->vad = self->engine && (self->voice_detection || self->dtx != DTX_OFF);
+  if (self->vad)
+    ap_voice_detection(self->engine, TRUE);
+  if (self->engine && self->async)
+    self->workers = gst_webrtc_worker_queue_new (
+        gst_webrtc_audio_processor_run_job, self,
+        gst_webrtc_audio_processor_free_job, ASYNC_MAX_JOBS);
+  g_atomic_int_set (&self->async_ret, GST_FLOW_OK);
+  self->out_flushing = FALSE;
+  self->out_busy = FALSE;
+  self->stream_has_voice = FALSE;
+  self->vad_run = 0;
+  g_atomic_int_set (&self->config_pending, FALSE);
+  probe_name = g_strdup (self->probe_name);
   GST_OBJECT_UNLOCK (self);
 
+  if (!self->engine) {
+    GST_ELEMENT_ERROR (self, LIBRARY, INIT,
+        ("Could not create the audio processing engine."), (NULL));
+    g_free (probe_name);
+    return FALSE;
+  }
+
+  self->probe = gst_webrtc_audio_probe_acquire (probe_name, GST_ELEMENT (self), self->engine);
+
+  if (self->probe)
+    GST_DEBUG_OBJECT (self, "Feeding far end from %" GST_PTR_FORMAT, self->probe);
+  else if (probe_name) {
+    GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+        ("No free webrtcaudioprobe named '%s' found.", probe_name), (NULL));
+    g_free (probe_name);
+    gst_webrtc_worker_queue_free (self->workers);
+    self->workers = NULL;
+    ap_delete (self->engine);
+    self->engine = NULL;
+    return FALSE;
+  }
+  else if (self->echo_cancel)
+    GST_WARNING_OBJECT (self, "No free webrtcaudioprobe, echo cancellation will have no far end signal.");
+
+  g_free (probe_name);
+
+  if (self->workers)
+    gst_pad_start_task (GST_BASE_TRANSFORM_SRC_PAD (btrans),
+        gst_webrtc_audio_processor_push_loop, self, NULL);
+
   return TRUE;
 }
 
+static void
+gst_webrtc_audio_processor_free_scratch (GstWebrtcAudioProcessor * self)
+{
+  g_free (self->scratch);
+  self->scratch = NULL;
+  g_free (self->scratch_planes);
+  self->scratch_planes = NULL;
+}
+
+static void
+gst_webrtc_audio_processor_free_resampling (GstWebrtcAudioProcessor * self)
+{
+  gst_webrtc_resampler_free (self->down);
+  self->down = NULL;
+  gst_webrtc_resampler_free (self->up);
+  self->up = NULL;
+  g_free (self->rs_in);
+  self->rs_in = NULL;
+  g_free (self->rs_in_planes);
+  self->rs_in_planes = NULL;
+  g_free (self->rs_proc);
+  self->rs_proc = NULL;
+  g_free (self->rs_proc_planes);
+  self->rs_proc_planes = NULL;
+  g_free (self->rs_batch_planes);
+  self->rs_batch_planes = NULL;
+  g_free (self->rs_out);
+  self->rs_out = NULL;
+  g_free (self->rs_out_planes);
+  self->rs_out_planes = NULL;
+}
+
+/* The rate the engine processes a stream at: its own when supported,
+ * otherwise the next higher supported one so no bandwidth is lost */
+static gint
+gst_webrtc_audio_processor_proc_rate (gint rate)
+{
+  static const gint rates[] = { 8000, 16000, 32000, 48000 };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (rates); i++)
+    if (rate <= rates[i])
+      return rates[i];
+
+  return 48000;
+}
+
+static void
+gst_webrtc_audio_processor_setup_resampling (GstWebrtcAudioProcessor * self)
+{
+  guint channels = self->info.channels;
+  guint c, p;
+
+  self->proc_period_samples = self->proc_rate / 100;
+  /* Each holds at most a batch and the period fed past it */
+  self->down = gst_webrtc_resampler_new (channels, self->info.rate,
+      self->proc_rate, (MAX_BATCH_PERIODS + 2) * self->period_samples);
+  self->up = gst_webrtc_resampler_new (channels, self->proc_rate,
+      self->info.rate, (MAX_BATCH_PERIODS + 2) * self->proc_period_samples);
+
+  self->rs_in = g_new (float, channels * self->period_samples);
+  self->rs_in_planes = g_new (float *, channels);
+  self->rs_proc = g_new (float,
+      channels * MAX_BATCH_PERIODS * self->proc_period_samples);
+  self->rs_proc_planes = g_new (float *, channels);
+  self->rs_batch_planes = g_new (float *, MAX_BATCH_PERIODS * channels);
+
+  /* A batch at the stream rate, plus slack for the resampler's fractions */
+  self->rs_out_samples = (MAX_BATCH_PERIODS + 1) * self->period_samples;
+  self->rs_out = g_new (float, channels * self->rs_out_samples);
+  self->rs_out_planes = g_new (float *, channels);
+
+  for (c = 0; c < channels; c++) {
+    self->rs_in_planes[c] = self->rs_in + c * self->period_samples;
+    self->rs_proc_planes[c] =
+        self->rs_proc + c * MAX_BATCH_PERIODS * self->proc_period_samples;
+    self->rs_out_planes[c] = self->rs_out + c * self->rs_out_samples;
+
+    for (p = 0; p < MAX_BATCH_PERIODS; p++)
+      self->rs_batch_planes[p * channels + c] =
+          self->rs_proc_planes[c] + p * self->proc_period_samples;
+  }
+
+  self->rs_pts = GST_CLOCK_TIME_NONE;
+  self->rs_proc_samples = 0;
+  self->rs_samples = 0;
+}
+
 static gboolean
 gst_webrtc_audio_processor_setup (GstAudioFilter * filter, const GstAudioInfo * info)
 {
@@ -336,13 +1676,47 @@ gst_webrtc_audio_processor_setup (GstAudioFilter * filter, const GstAudioInfo *
   GST_OBJECT_LOCK (self);
 
   gst_adapter_clear (self->adapter);
+  gst_planar_audio_adapter_clear (self->padapter);
+  gst_webrtc_audio_processor_clear_slices (self);
+  gst_buffer_replace (&self->carry, NULL);
 
   self->info = *info;
+  self->interleaved = (info->layout == GST_AUDIO_LAYOUT_INTERLEAVED);
+
+  self->proc_rate = gst_webrtc_audio_processor_proc_rate (info->rate);
+
+  /* Periods of non-interleaved audio are not contiguous in memory, those
+   * always go through the planar adapter, and so does resampled audio */
+  self->slice_in_place = self->in_place && self->interleaved &&
+      self->proc_rate == info->rate;
+
+  if (!self->interleaved)
+    gst_planar_audio_adapter_configure (self->padapter, info);
 
   /* WebRTC works with 10ms (.01s) buffers, compute period_size once */
   self->period_samples = info->rate / 100;
   self->period_size = self->period_samples * info->bpf;
 
+  gst_webrtc_audio_processor_free_scratch (self);
+  gst_webrtc_audio_processor_free_resampling (self);
+
+  if (self->interleaved) {
+    guint c;
+
+    self->scratch = g_new (float,
+        MAX_BATCH_PERIODS * info->channels * self->period_samples);
+    self->scratch_planes = g_new (float *, MAX_BATCH_PERIODS * info->channels);
+
+    for (c = 0; c < MAX_BATCH_PERIODS * (guint) info->channels; c++)
+      self->scratch_planes[c] = self->scratch + c * self->period_samples;
+  }
+
+  if (self->proc_rate != info->rate) {
+    GST_INFO_OBJECT (self, "Resampling %d Hz to %d Hz for processing",
+        info->rate, self->proc_rate);
+    gst_webrtc_audio_processor_setup_resampling (self);
+  }
+
 #ifdef _WAIT
   /* input stream */
   pconfig.streams[webrtc::ProcessingConfig::kInputStream] =
@@ -358,35 +1732,82 @@ gst_webrtc_audio_processor_setup (GstAudioFilter * filter, const GstAudioInfo *
       webrtc::StreamConfig (probe_info.rate, probe_info.channels, false);
 #endif
 
-#ifdef _WAIT_VAD
-  if (self->voice_detection) {
-    self->stream_has_voice = FALSE;
-
-    apm->voice_detection ()->Enable (true);
-  }
-#endif
+  self->stream_has_voice = FALSE;
+  self->vad_run = 0;
 
   GST_OBJECT_UNLOCK (self);
 
   return TRUE;
 }
 
+/* Pads are deactivated sources first, so the source pad task must be
+ * stopped here: it holds the stream lock the deactivation waits for,
+ * and stop() only runs once the sink pad goes */
+static gboolean
+gst_webrtc_audio_processor_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active)
+{
+  GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (parent);
+
+  if (!active) {
+    gst_webrtc_audio_processor_set_out_flushing (self, TRUE);
+    gst_pad_stop_task (pad);
+  }
+
+  return self->src_activate_mode (pad, parent, mode, active);
+}
+
 static gboolean
 gst_webrtc_audio_processor_stop (GstBaseTransform * btrans)
 {
   GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (btrans);
 
+  /* Drops the waiting inputs and waits for the running one. The source pad
+   * task was already stopped with the pad, stopping it again is a no-op. */
+  if (self->workers) {
+    gst_webrtc_worker_queue_free (self->workers);
+    self->workers = NULL;
+    gst_webrtc_audio_processor_set_out_flushing (self, TRUE);
+    gst_pad_stop_task (GST_BASE_TRANSFORM_SRC_PAD (btrans));
+    gst_webrtc_audio_processor_clear_outputs (self);
+  }
+
+  if (self->probe) {
+    gst_webrtc_audio_probe_release (self->probe);
+    self->probe = NULL;
+  }
+
   GST_OBJECT_LOCK (self);
 
   gst_adapter_clear (self->adapter);
-
-  ap_delete();
+  gst_planar_audio_adapter_clear (self->padapter);
+  gst_webrtc_audio_processor_clear_slices (self);
+  gst_buffer_replace (&self->carry, NULL);
+  gst_webrtc_audio_processor_reset_resampling (self);
+
+  gst_webrtc_audio_processor_free_pool (&self->pool);
+  gst_webrtc_audio_processor_free_pool (&self->body_pool);
+  self->body_size = 0;
+
+  if (self->engine) {
+    ap_delete(self->engine);
+    self->engine = NULL;
+  }
 
   GST_OBJECT_UNLOCK (self);
 
   return TRUE;
 }
 
+/* Called with the object lock held. Before start() the values simply go to
+ * ap_setup(). */
+static void
+gst_webrtc_audio_processor_schedule_config (GstWebrtcAudioProcessor * self)
+{
+  if (self->engine)
+    g_atomic_int_set (&self->config_pending, TRUE);
+}
+
 static void
 gst_webrtc_audio_processor_set_property (GObject * object,
     guint prop_id, const GValue * value, GParamSpec * pspec)
@@ -404,21 +1825,44 @@ gst_webrtc_audio_processor_set_property (GObject * object,
       break;
     case PROP_ECHO_CANCEL:
       self->echo_cancel = g_value_get_boolean (value);
+      gst_webrtc_audio_processor_schedule_config (self);
       break;
     case PROP_NOISE_SUPPRESSION:
       self->noise_suppression = g_value_get_boolean (value);
+      gst_webrtc_audio_processor_schedule_config (self);
       break;
     case PROP_NOISE_SUPPRESSION_LEVEL:
       self->noise_suppression_level =
           (GstWebrtcAudioProcessingNoiseSuppressionLevel) g_value_get_enum (value);
+      gst_webrtc_audio_processor_schedule_config (self);
       break;
-#ifdef _WAIT_VAD
     case PROP_VOICE_DETECTION:
       self->voice_detection = g_value_get_boolean (value);
+      gst_webrtc_audio_processor_schedule_config (self);
       break;
-#endif
     case PROP_GAIN_CONTROLLER:
       self->gain_controller = g_value_get_boolean (value);
+      gst_webrtc_audio_processor_schedule_config (self);
+      break;
+    case PROP_PROBE:
+      g_free (self->probe_name);
+      self->probe_name = g_value_dup_string (value);
+      break;
+    case PROP_IN_PLACE:
+      self->in_place = g_value_get_boolean (value);
+      break;
+    case PROP_MIN_BUFFERS:
+      self->min_buffers = g_value_get_uint (value);
+      break;
+    case PROP_MAX_BUFFERS:
+      self->max_buffers = g_value_get_uint (value);
+      break;
+    case PROP_DTX_MODE:
+      self->dtx_mode = (GstWebrtcAudioProcessingDtxMode) g_value_get_enum (value);
+      gst_webrtc_audio_processor_schedule_config (self);
+      break;
+    case PROP_ASYNC:
+      self->async = g_value_get_boolean (value);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -450,14 +1894,30 @@ gst_webrtc_audio_processor_get_property (GObject * object,
     case PROP_NOISE_SUPPRESSION_LEVEL:
       g_value_set_enum (value, self->noise_suppression_level);
       break;
-#ifdef _WAIT_VAD
     case PROP_VOICE_DETECTION:
       g_value_set_boolean (value, self->voice_detection);
       break;
-#endif
     case PROP_GAIN_CONTROLLER:
       g_value_set_boolean (value, self->gain_controller);
       break;
+    case PROP_PROBE:
+      g_value_set_string (value, self->probe_name);
+      break;
+    case PROP_IN_PLACE:
+      g_value_set_boolean (value, self->in_place);
+      break;
+    case PROP_MIN_BUFFERS:
+      g_value_set_uint (value, self->min_buffers);
+      break;
+    case PROP_MAX_BUFFERS:
+      g_value_set_uint (value, self->max_buffers);
+      break;
+    case PROP_DTX_MODE:
+      g_value_set_enum (value, self->dtx_mode);
+      break;
+    case PROP_ASYNC:
+      g_value_set_boolean (value, self->async);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -472,15 +1932,45 @@ gst_webrtc_audio_processor_finalize (GObject * object)
   GstWebrtcAudioProcessor *self = GST_WEBRTC_AUDIO_PROCESSOR (object);
 
   gst_object_unref (self->adapter);
+  gst_object_unref (self->padapter);
+  gst_webrtc_audio_processor_free_scratch (self);
+  gst_webrtc_audio_processor_free_resampling (self);
+  g_free (self->probe_name);
+  g_mutex_clear (&self->out_lock);
+  g_cond_clear (&self->out_cond);
 
   G_OBJECT_CLASS (gst_webrtc_audio_processor_parent_class)->finalize (object);
 }
 
+/**
+ * gst_webrtc_audio_processor_set_probe:
+ * @self: a #GstWebrtcAudioProcessor
+ * @name: the name of a webrtcaudioprobe, or %NULL for the first free one
+ *
+ * Pairs the processor with a specific probe. Takes effect the next time the
+ * processor is started.
+ */
+void
+gst_webrtc_audio_processor_set_probe (GstWebrtcAudioProcessor * self, const gchar * name)
+{
+  g_return_if_fail (GST_IS_WEBRTC_AUDIO_PROCESSOR (self));
+
+  g_object_set (self, "probe", name, NULL);
+}
+
 static void
 gst_webrtc_audio_processor_init (GstWebrtcAudioProcessor * self)
 {
   self->adapter = gst_adapter_new ();
+  self->padapter = gst_planar_audio_adapter_new ();
   gst_audio_info_init (&self->info);
+  self->src_activate_mode =
+      GST_PAD_ACTIVATEMODEFUNC (GST_BASE_TRANSFORM_SRC_PAD (self));
+  gst_pad_set_activatemode_function (GST_BASE_TRANSFORM_SRC_PAD (self),
+      GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_src_activate_mode));
+  g_mutex_init (&self->out_lock);
+  g_cond_init (&self->out_cond);
+  g_queue_init (&self->outputs);
 }
 
 static void
@@ -502,6 +1992,12 @@ gst_webrtc_audio_processor_class_init (GstWebrtcAudioProcessorClass * klass)
       GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_submit_input_buffer);
   btrans_class->generate_output =
       GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_generate_output);
+  btrans_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_sink_event);
+  btrans_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_decide_allocation);
+  btrans_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_propose_allocation);
 
   audiofilter_class->setup = GST_DEBUG_FUNCPTR (gst_webrtc_audio_processor_setup);
 
@@ -535,14 +2031,14 @@ gst_webrtc_audio_processor_class_init (GstWebrtcAudioProcessorClass * klass)
       g_param_spec_boolean ("echo-cancel", "Echo Cancel",
           "Enable or disable echo canceller", FALSE,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
-              G_PARAM_CONSTRUCT)));
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
 
   g_object_class_install_property (gobject_class,
       PROP_NOISE_SUPPRESSION,
       g_param_spec_boolean ("noise-suppression", "Noise Suppression",
           "Enable or disable noise suppression", FALSE,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
-              G_PARAM_CONSTRUCT)));
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
 
   g_object_class_install_property (gobject_class,
       PROP_NOISE_SUPPRESSION_LEVEL,
@@ -552,25 +2048,91 @@ gst_webrtc_audio_processor_class_init (GstWebrtcAudioProcessorClass * klass)
           "speech distortion.", GST_TYPE_WEBRTC_NOISE_SUPPRESSION_LEVEL,
           NSL_MODERATE,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
-              G_PARAM_CONSTRUCT)));
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
 
-#ifdef _WAIT_VAD
   g_object_class_install_property (gobject_class,
       PROP_VOICE_DETECTION,
       g_param_spec_boolean ("voice-detection", "Voice Detection",
-          "Enable or disable the voice activity detector",
+          "Enable or disable the voice activity detector. Transitions are "
+          "posted as voice-activity element messages.",
           DEFAULT_VOICE_DETECTION, (GParamFlags) (G_PARAM_READWRITE |
-              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
-#endif
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT |
+              GST_PARAM_MUTABLE_PLAYING)));
 
   g_object_class_install_property (gobject_class,
       PROP_GAIN_CONTROLLER,
       g_param_spec_boolean ("gain-controller", "Gain Controller",
           "Enable or disable the gain controller",
           DEFAULT_GAIN_CONTROLLER, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT |
+              GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_PROBE,
+      g_param_spec_string ("probe", "Probe",
+          "The name of the webrtcaudioprobe element that records the far end "
+          "signal, or NULL for the first one not used by another processor",
+          DEFAULT_PROBE, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_IN_PLACE,
+      g_param_spec_boolean ("in-place", "In Place",
+          "Process whole periods inside the incoming buffers instead of "
+          "slicing them into newly allocated 10ms buffers. Only applies to "
+          "interleaved audio and takes effect on the next caps negotiation.",
+          DEFAULT_IN_PLACE, (GParamFlags) (G_PARAM_READWRITE |
               G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
 
+  g_object_class_install_property (gobject_class,
+      PROP_MIN_BUFFERS,
+      g_param_spec_uint ("min-buffers", "Min Buffers",
+          "Number of 10ms buffers preallocated in the buffer pools",
+          0, G_MAXUINT, DEFAULT_MIN_BUFFERS, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_MAX_BUFFERS,
+      g_param_spec_uint ("max-buffers", "Max Buffers",
+          "Maximum number of 10ms buffers in the buffer pools (0 = unlimited)",
+          0, G_MAXUINT, DEFAULT_MAX_BUFFERS, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_DTX_MODE,
+      g_param_spec_enum ("dtx-mode", "DTX Mode",
+          "What to output for periods without voice. Enables the voice "
+          "activity detector when not off.", GST_TYPE_WEBRTC_DTX_MODE,
+          DEFAULT_DTX_MODE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_ASYNC,
+      g_param_spec_boolean ("async", "Asynchronous",
+          "Process audio on a thread pool shared by every processor of the "
+          "process instead of the upstream streaming thread, and push it "
+          "from a thread of the processor. Takes effect the next time the "
+          "processor is started.",
+          DEFAULT_ASYNC, (GParamFlags) (G_PARAM_READWRITE |
+              G_PARAM_STATIC_STRINGS | G_PARAM_CONSTRUCT)));
+
+  /**
+   * GstWebrtcAudioProcessor::reconfigured:
+   * @processor: the #GstWebrtcAudioProcessor
+   * @stream_time: stream time of the first period processed with the new
+   *   settings
+   *
+   * Emitted from the streaming thread once a change of echo-cancel,
+   * noise-suppression, noise-suppression-level, gain-controller,
+   * voice-detection or dtx-mode made while running has taken effect in the engine.
+   */
+  gst_webrtc_audio_processor_signals[SIGNAL_RECONFIGURED] =
+      g_signal_new ("reconfigured", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_UINT64);
+
   gst_type_mark_as_plugin_api (GST_TYPE_WEBRTC_NOISE_SUPPRESSION_LEVEL, (GstPluginAPIFlags) 0);
+  gst_type_mark_as_plugin_api (GST_TYPE_WEBRTC_DTX_MODE, (GstPluginAPIFlags) 0);
 }
 
 static gboolean
@@ -587,6 +2149,14 @@ plugin_init (GstPlugin * plugin)
           GST_TYPE_WEBRTC_AUDIO_PROBE)) {
     return FALSE;
   }
+  if (!gst_element_register (plugin, "webrtcmultiprocessor", GST_RANK_NONE,
+          GST_TYPE_WEBRTC_MULTI_PROCESSOR)) {
+    return FALSE;
+  }
+  if (!gst_element_register (plugin, "webrtcechocanceller", GST_RANK_NONE,
+          GST_TYPE_WEBRTC_ECHO_CANCELLER)) {
+    return FALSE;
+  }
 
   return TRUE;
 }
@@ -0,0 +1,405 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* S16 <-> float conversion kernels feeding the engine's float entry points.
+ *
+ * The vector kernels specialise mono and stereo, by far the most common
+ * layouts, and hand any other channel count and the trailing samples over
+ * to the scalar reference. Every kernel rounds to nearest even, saturates
+ * and turns NaN into 0 exactly like the reference, so they are
+ * interchangeable bit for bit, as tests/test-convert.cpp checks. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "gst/webrtcaudioprocessing/gstwebrtcconvert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+#define S16_TO_FLOAT (1.0f / 32768.0f)
+#define FLOAT_TO_S16 32768.0f
+
+static inline gint16
+float_to_s16 (float v)
+{
+  if (isnan (v))
+    return 0;
+
+  v *= FLOAT_TO_S16;
+  v = v < -32768.0f ? -32768.0f : (v > 32767.0f ? 32767.0f : v);
+
+  return (gint16) lrintf (v);
+}
+
+static void
+deinterleave_scalar_from (const gint16 * src, float * const * dst,
+    guint channels, guint samples, guint start)
+{
+  guint i, c;
+
+  for (c = 0; c < channels; c++) {
+    float *d = dst[c];
+
+    for (i = start; i < samples; i++)
+      d[i] = src[i * channels + c] * S16_TO_FLOAT;
+  }
+}
+
+static void
+interleave_scalar_from (const float * const * src, gint16 * dst,
+    guint channels, guint samples, guint start)
+{
+  guint i, c;
+
+  for (c = 0; c < channels; c++) {
+    const float *s = src[c];
+
+    for (i = start; i < samples; i++)
+      dst[i * channels + c] = float_to_s16 (s[i]);
+  }
+}
+
+static void
+deinterleave_scalar (const gint16 * src, float * const * dst,
+    guint channels, guint samples)
+{
+  deinterleave_scalar_from (src, dst, channels, samples, 0);
+}
+
+static void
+interleave_scalar (const float * const * src, gint16 * dst,
+    guint channels, guint samples)
+{
+  interleave_scalar_from (src, dst, channels, samples, 0);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__ ((target ("sse2")))
+static inline __m128i
+sse2_float_to_s32 (__m128 v)
+{
+  /* NaN compares unordered with itself, masking it to 0 */
+  v = _mm_and_ps (v, _mm_cmpord_ps (v, v));
+  v = _mm_mul_ps (v, _mm_set1_ps (FLOAT_TO_S16));
+  v = _mm_min_ps (_mm_max_ps (v, _mm_set1_ps (-32768.0f)), _mm_set1_ps (32767.0f));
+
+  return _mm_cvtps_epi32 (v);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+deinterleave_sse2 (const gint16 * src, float * const * dst,
+    guint channels, guint samples)
+{
+  const __m128 scale = _mm_set1_ps (S16_TO_FLOAT);
+  guint i = 0;
+
+  if (channels == 1) {
+    for (; i + 8 <= samples; i += 8) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+      __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+      __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+
+      _mm_storeu_ps (dst[0] + i, _mm_mul_ps (_mm_cvtepi32_ps (lo), scale));
+      _mm_storeu_ps (dst[0] + i + 4, _mm_mul_ps (_mm_cvtepi32_ps (hi), scale));
+    }
+  } else if (channels == 2) {
+    for (; i + 4 <= samples; i += 4) {
+      /* Each 32 bits hold one frame, left in the low half */
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i * 2));
+      __m128i l = _mm_srai_epi32 (_mm_slli_epi32 (v, 16), 16);
+      __m128i r = _mm_srai_epi32 (v, 16);
+
+      _mm_storeu_ps (dst[0] + i, _mm_mul_ps (_mm_cvtepi32_ps (l), scale));
+      _mm_storeu_ps (dst[1] + i, _mm_mul_ps (_mm_cvtepi32_ps (r), scale));
+    }
+  }
+
+  deinterleave_scalar_from (src, dst, channels, samples, i);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+interleave_sse2 (const float * const * src, gint16 * dst,
+    guint channels, guint samples)
+{
+  guint i = 0;
+
+  if (channels == 1) {
+    for (; i + 8 <= samples; i += 8) {
+      __m128i lo = sse2_float_to_s32 (_mm_loadu_ps (src[0] + i));
+      __m128i hi = sse2_float_to_s32 (_mm_loadu_ps (src[0] + i + 4));
+
+      _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packs_epi32 (lo, hi));
+    }
+  } else if (channels == 2) {
+    for (; i + 4 <= samples; i += 4) {
+      __m128i l = sse2_float_to_s32 (_mm_loadu_ps (src[0] + i));
+      __m128i r = sse2_float_to_s32 (_mm_loadu_ps (src[1] + i));
+      /* l0 l1 l2 l3 r0 r1 r2 r3 */
+      __m128i p = _mm_packs_epi32 (l, r);
+
+      _mm_storeu_si128 ((__m128i *) (dst + i * 2),
+          _mm_unpacklo_epi16 (p, _mm_srli_si128 (p, 8)));
+    }
+  }
+
+  interleave_scalar_from (src, dst, channels, samples, i);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+avx2_float_to_s32 (__m256 v)
+{
+  v = _mm256_and_ps (v, _mm256_cmp_ps (v, v, _CMP_ORD_Q));
+  v = _mm256_mul_ps (v, _mm256_set1_ps (FLOAT_TO_S16));
+  v = _mm256_min_ps (_mm256_max_ps (v, _mm256_set1_ps (-32768.0f)),
+      _mm256_set1_ps (32767.0f));
+
+  return _mm256_cvtps_epi32 (v);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+deinterleave_avx2 (const gint16 * src, float * const * dst,
+    guint channels, guint samples)
+{
+  const __m256 scale = _mm256_set1_ps (S16_TO_FLOAT);
+  guint i = 0;
+
+  if (channels == 1) {
+    for (; i + 16 <= samples; i += 16) {
+      __m128i lo = _mm_loadu_si128 ((const __m128i *) (src + i));
+      __m128i hi = _mm_loadu_si128 ((const __m128i *) (src + i + 8));
+
+      _mm256_storeu_ps (dst[0] + i,
+          _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (lo)), scale));
+      _mm256_storeu_ps (dst[0] + i + 8,
+          _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (hi)), scale));
+    }
+  } else if (channels == 2) {
+    /* Per lane, gather the four left samples then the four right ones */
+    const __m256i split = _mm256_setr_epi8 (
+        0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15,
+        0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+
+    for (; i + 8 <= samples; i += 8) {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (src + i * 2));
+
+      /* l0-3 r0-3 | l4-7 r4-7 -> l0-7 | r0-7 */
+      v = _mm256_shuffle_epi8 (v, split);
+      v = _mm256_permute4x64_epi64 (v, _MM_SHUFFLE (3, 1, 2, 0));
+
+      _mm256_storeu_ps (dst[0] + i, _mm256_mul_ps (_mm256_cvtepi32_ps (
+                  _mm256_cvtepi16_epi32 (_mm256_castsi256_si128 (v))), scale));
+      _mm256_storeu_ps (dst[1] + i, _mm256_mul_ps (_mm256_cvtepi32_ps (
+                  _mm256_cvtepi16_epi32 (_mm256_extracti128_si256 (v, 1))), scale));
+    }
+  }
+
+  deinterleave_scalar_from (src, dst, channels, samples, i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+interleave_avx2 (const float * const * src, gint16 * dst,
+    guint channels, guint samples)
+{
+  guint i = 0;
+
+  if (channels == 1) {
+    for (; i + 16 <= samples; i += 16) {
+      __m256i lo = avx2_float_to_s32 (_mm256_loadu_ps (src[0] + i));
+      __m256i hi = avx2_float_to_s32 (_mm256_loadu_ps (src[0] + i + 8));
+      /* lo0-3 hi0-3 | lo4-7 hi4-7 */
+      __m256i p = _mm256_packs_epi32 (lo, hi);
+
+      _mm256_storeu_si256 ((__m256i *) (dst + i),
+          _mm256_permute4x64_epi64 (p, _MM_SHUFFLE (3, 1, 2, 0)));
+    }
+  } else if (channels == 2) {
+    /* Per lane, interleave the four left samples with the four right ones */
+    const __m256i zip = _mm256_setr_epi8 (
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+        0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+
+    for (; i + 8 <= samples; i += 8) {
+      __m256i l = avx2_float_to_s32 (_mm256_loadu_ps (src[0] + i));
+      __m256i r = avx2_float_to_s32 (_mm256_loadu_ps (src[1] + i));
+      /* l0-3 r0-3 | l4-7 r4-7 */
+      __m256i p = _mm256_packs_epi32 (l, r);
+
+      _mm256_storeu_si256 ((__m256i *) (dst + i * 2),
+          _mm256_shuffle_epi8 (p, zip));
+    }
+  }
+
+  interleave_scalar_from (src, dst, channels, samples, i);
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+
+static inline int32x4_t
+neon_float_to_s32 (float32x4_t v)
+{
+  v = vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (v),
+          vceqq_f32 (v, v)));
+  v = vmulq_n_f32 (v, FLOAT_TO_S16);
+  v = vminq_f32 (vmaxq_f32 (v, vdupq_n_f32 (-32768.0f)), vdupq_n_f32 (32767.0f));
+
+  return vcvtnq_s32_f32 (v);
+}
+
+static void
+deinterleave_neon (const gint16 * src, float * const * dst,
+    guint channels, guint samples)
+{
+  guint i = 0;
+
+  if (channels == 1) {
+    for (; i + 8 <= samples; i += 8) {
+      int16x8_t v = vld1q_s16 (src + i);
+
+      vst1q_f32 (dst[0] + i, vmulq_n_f32 (vcvtq_f32_s32 (
+                  vmovl_s16 (vget_low_s16 (v))), S16_TO_FLOAT));
+      vst1q_f32 (dst[0] + i + 4, vmulq_n_f32 (vcvtq_f32_s32 (
+                  vmovl_s16 (vget_high_s16 (v))), S16_TO_FLOAT));
+    }
+  } else if (channels == 2) {
+    for (; i + 8 <= samples; i += 8) {
+      int16x8x2_t v = vld2q_s16 (src + i * 2);
+      guint c;
+
+      for (c = 0; c < 2; c++) {
+        vst1q_f32 (dst[c] + i, vmulq_n_f32 (vcvtq_f32_s32 (
+                    vmovl_s16 (vget_low_s16 (v.val[c]))), S16_TO_FLOAT));
+        vst1q_f32 (dst[c] + i + 4, vmulq_n_f32 (vcvtq_f32_s32 (
+                    vmovl_s16 (vget_high_s16 (v.val[c]))), S16_TO_FLOAT));
+      }
+    }
+  }
+
+  deinterleave_scalar_from (src, dst, channels, samples, i);
+}
+
+static void
+interleave_neon (const float * const * src, gint16 * dst,
+    guint channels, guint samples)
+{
+  guint i = 0;
+
+  if (channels == 1) {
+    for (; i + 8 <= samples; i += 8) {
+      int16x4_t lo = vqmovn_s32 (neon_float_to_s32 (vld1q_f32 (src[0] + i)));
+      int16x4_t hi = vqmovn_s32 (neon_float_to_s32 (vld1q_f32 (src[0] + i + 4)));
+
+      vst1q_s16 (dst + i, vcombine_s16 (lo, hi));
+    }
+  } else if (channels == 2) {
+    for (; i + 8 <= samples; i += 8) {
+      int16x8x2_t v;
+      guint c;
+
+      for (c = 0; c < 2; c++)
+        v.val[c] = vcombine_s16 (
+            vqmovn_s32 (neon_float_to_s32 (vld1q_f32 (src[c] + i))),
+            vqmovn_s32 (neon_float_to_s32 (vld1q_f32 (src[c] + i + 4))));
+
+      vst2q_s16 (dst + i * 2, v);
+    }
+  }
+
+  interleave_scalar_from (src, dst, channels, samples, i);
+}
+
+#endif /* HAVE_NEON_KERNELS */
+
+static GstWebrtcConvertKernel kernels[4];
+static guint n_kernels;
+
+static void
+gst_webrtc_convert_init (void)
+{
+  static gsize initialized = 0;
+
+  if (!g_once_init_enter (&initialized))
+    return;
+
+  kernels[n_kernels++] = { "scalar", deinterleave_scalar, interleave_scalar };
+
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("sse2"))
+    kernels[n_kernels++] = { "sse2", deinterleave_sse2, interleave_sse2 };
+  if (__builtin_cpu_supports ("avx2"))
+    kernels[n_kernels++] = { "avx2", deinterleave_avx2, interleave_avx2 };
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+  kernels[n_kernels++] = { "neon", deinterleave_neon, interleave_neon };
+#endif
+
+  g_once_init_leave (&initialized, 1);
+}
+
+const GstWebrtcConvertKernel*
+gst_webrtc_convert_kernels (guint * count)
+{
+  gst_webrtc_convert_init ();
+
+  *count = n_kernels;
+
+  return kernels;
+}
+
+void
+gst_webrtc_deinterleave_s16 (const gint16 * src, float * const * dst,
+    guint channels, guint samples)
+{
+  gst_webrtc_convert_init ();
+
+  kernels[n_kernels - 1].deinterleave (src, dst, channels, samples);
+}
+
+void
+gst_webrtc_interleave_s16 (const float * const * src, gint16 * dst,
+    guint channels, guint samples)
+{
+  gst_webrtc_convert_init ();
+
+  kernels[n_kernels - 1].interleave (src, dst, channels, samples);
+}
@@ -0,0 +1,697 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/**
+ * SECTION:element-webrtcechocanceller
+ * @short_description: Echo canceller taking the far end on a second pad
+ *
+ * Cancels the echo of the far end, received on the reverse pad, from the
+ * near end, received on the sink pad, and outputs the processed near end.
+ * Unlike the webrtcaudioprocessor / webrtcaudioprobe pair, both streams go
+ * through this one element: they are lined up by running time and the
+ * engine gets each near end period along with the far end period that
+ * played at the same running time, all on the aggregator's thread, without
+ * any lock or shared queue.
+ *
+ * Running time only covers what the pipeline knows. The time the far end
+ * takes from the reverse pad to the loudspeaker, and the near end from the
+ * microphone to the sink pad, is left to the engine's delay estimation,
+ * starting from #GstWebrtcEchoCanceller:delay.
+ *
+ * In live pipelines, a far end late by more than the aggregator latency is
+ * skipped, and the near end processed without it.
+ *
+ * # Example launch line
+ *
+ * |[
+ * gst-launch-1.0 webrtcechocanceller name=aec ! audioconvert ! autoaudiosink \
+ *   pulsesrc ! aec.sink \
+ *   audiotestsrc is-live=true wave=ticks ! tee name=t ! queue ! aec.reverse \
+ *   t. ! queue ! pulsesink
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gst/webrtcaudioprocessing/gstwebrtcechocanceller.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcaudioprocessor.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcconvert.h"
+
+GST_DEBUG_CATEGORY_EXTERN (webrtc_audio_processor_debug);
+#define GST_CAT_DEFAULT (webrtc_audio_processor_debug)
+
+#define DEFAULT_ECHO_CANCEL TRUE
+#define DEFAULT_NOISE_SUPPRESSION FALSE
+#define DEFAULT_GAIN_CONTROLLER FALSE
+#define DEFAULT_DELAY 0
+
+#define PERIOD_DURATION (10 * GST_MSECOND)
+
+/* Highest rate the engine processes at internally, as webrtcaudioprocessor
+ * by default */
+#define PROCESSING_RATE 48000
+
+/* Periods handed to the engine per call */
+#define MAX_BATCH_PERIODS 10
+
+/* Far end kept ahead of the near end, older audio is dropped */
+#define MAX_REVERSE_DURATION GST_SECOND
+
+#define WEBRTC_CAPS \
+    "audio/x-raw, " \
+    "format = (string) " GST_AUDIO_NE (S16) ", " \
+    "layout = (string) interleaved, " \
+    "rate = (int) { 48000, 32000, 16000, 8000 }, " \
+    "channels = (int) [1, MAX]"
+
+static GstStaticPadTemplate gst_webrtc_echo_canceller_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (WEBRTC_CAPS)
+    );
+
+static GstStaticPadTemplate gst_webrtc_echo_canceller_reverse_template =
+GST_STATIC_PAD_TEMPLATE ("reverse",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (WEBRTC_CAPS)
+    );
+
+static GstStaticPadTemplate gst_webrtc_echo_canceller_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (WEBRTC_CAPS)
+    );
+
+enum
+{
+  PROP_0,
+  PROP_ECHO_CANCEL,
+  PROP_NOISE_SUPPRESSION,
+  PROP_NOISE_SUPPRESSION_LEVEL,
+  PROP_GAIN_CONTROLLER,
+  PROP_DELAY,
+};
+
+/* What the far end has for a near end period */
+typedef enum
+{
+  REVERSE_FED,
+  REVERSE_NONE,
+  REVERSE_WAIT
+} GstWebrtcReverseStatus;
+
+G_DEFINE_TYPE (GstWebrtcEchoCanceller, gst_webrtc_echo_canceller, GST_TYPE_AGGREGATOR);
+
+static GstClockTime
+gst_webrtc_echo_canceller_running_time (GstAggregatorPad * pad,
+    GstClockTime timestamp)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (timestamp))
+    return GST_CLOCK_TIME_NONE;
+
+  return gst_segment_to_running_time (&pad->segment, GST_FORMAT_TIME, timestamp);
+}
+
+/* Moves every buffer queued on a pad into its adapter. The running time of
+ * the adapter's first sample is taken from the buffer starting it, the
+ * following ones are assumed contiguous unless flagged discont. */
+static void
+gst_webrtc_echo_canceller_gather (GstWebrtcEchoCanceller * self,
+    GstAggregatorPad * pad, GstAdapter * adapter, GstClockTime * time)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = gst_aggregator_pad_pop_buffer (pad))) {
+    if (GST_BUFFER_IS_DISCONT (buffer) || gst_adapter_available (adapter) == 0) {
+      gst_adapter_clear (adapter);
+      *time = gst_webrtc_echo_canceller_running_time (pad, GST_BUFFER_PTS (buffer));
+      if (pad == self->sinkpad)
+        self->discont = TRUE;
+    }
+
+    gst_adapter_push (adapter, buffer);
+  }
+}
+
+static void
+gst_webrtc_echo_canceller_flush_reverse (GstWebrtcEchoCanceller * self,
+    guint samples)
+{
+  gst_adapter_flush (self->reverse, samples * self->reverse_info.bpf);
+
+  if (GST_CLOCK_TIME_IS_VALID (self->reverse_time))
+    self->reverse_time += gst_util_uint64_scale_int (samples, GST_SECOND,
+        self->reverse_info.rate);
+}
+
+/* Hands the engine the far end period that played at running time rt, once
+ * older audio is dropped. A far end starting later than rt leaves the
+ * period without one, a far end not there yet is waited for unless the
+ * aggregator timed out or the reverse pad is done. */
+static GstWebrtcReverseStatus
+gst_webrtc_echo_canceller_feed_reverse (GstWebrtcEchoCanceller * self,
+    GstClockTime rt, gboolean timeout)
+{
+  gboolean give_up = timeout || gst_aggregator_pad_is_eos (self->reversepad);
+  guint available, drop;
+  const guint8 *data;
+  gint err;
+
+  if (!self->reverse_period_size)
+    return give_up ? REVERSE_NONE : REVERSE_WAIT;
+
+  available = gst_adapter_available (self->reverse) / self->reverse_info.bpf;
+
+  if (!GST_CLOCK_TIME_IS_VALID (rt) || !GST_CLOCK_TIME_IS_VALID (self->reverse_time)) {
+    /* Nothing to line up with, only keep the far end bounded */
+    drop = gst_util_uint64_scale_int (MAX_REVERSE_DURATION,
+        self->reverse_info.rate, GST_SECOND);
+    if (available > drop)
+      gst_webrtc_echo_canceller_flush_reverse (self, available - drop);
+    return REVERSE_NONE;
+  }
+
+  if (self->reverse_time < rt) {
+    drop = MIN (gst_util_uint64_scale_int (rt - self->reverse_time,
+            self->reverse_info.rate, GST_SECOND), available);
+    gst_webrtc_echo_canceller_flush_reverse (self, drop);
+    available -= drop;
+  }
+
+  if (self->reverse_time >= rt + PERIOD_DURATION / 2)
+    return REVERSE_NONE;
+
+  if (available < self->reverse_period_samples)
+    return give_up ? REVERSE_NONE : REVERSE_WAIT;
+
+  data = (const guint8 *) gst_adapter_map (self->reverse, self->reverse_period_size);
+  gst_webrtc_deinterleave_s16 ((const gint16 *) data, self->reverse_planes,
+      self->reverse_info.channels, self->reverse_period_samples);
+  gst_adapter_unmap (self->reverse);
+  gst_webrtc_echo_canceller_flush_reverse (self, self->reverse_period_samples);
+
+  err = ap_process_reverse_float(self->engine, self->reverse_info.rate, self->reverse_info.channels, self->reverse_planes);
+
+  if (err < 0)
+    GST_WARNING_OBJECT (self, "Failed to process far end: %s.",
+        ap_error (self->engine, err));
+
+  return REVERSE_FED;
+}
+
+static void
+gst_webrtc_echo_canceller_apply_config (GstWebrtcEchoCanceller * self)
+{
+  gboolean echo_cancel, noise_suppression, gain_controller;
+  int noise_suppression_level;
+  gint delay;
+
+  GST_OBJECT_LOCK (self);
+  echo_cancel = self->echo_cancel;
+  noise_suppression = self->noise_suppression;
+  noise_suppression_level = self->noise_suppression_level;
+  gain_controller = self->gain_controller;
+  delay = self->delay;
+  g_atomic_int_set (&self->config_pending, FALSE);
+  GST_OBJECT_UNLOCK (self);
+
+  ap_configure(self->engine, echo_cancel, noise_suppression, noise_suppression_level, gain_controller);
+  ap_delay(self->engine, delay);
+}
+
+/* Processes the next n_periods of near end, whose far end has been fed */
+static GstFlowReturn
+gst_webrtc_echo_canceller_process (GstWebrtcEchoCanceller * self,
+    guint n_periods)
+{
+  GstAggregator *agg = GST_AGGREGATOR (self);
+  guint channels = self->info.channels;
+  guint samples = self->period_samples * channels;
+  GstClockTime duration;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  guint p;
+  gint err;
+
+  buffer = gst_adapter_take_buffer (self->capture, n_periods * self->period_size);
+  buffer = gst_buffer_make_writable (buffer);
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READWRITE)) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  for (p = 0; p < n_periods; p++)
+    gst_webrtc_deinterleave_s16 ((const gint16 *) map.data + p * samples,
+        self->planes + p * channels, channels, self->period_samples);
+
+  err = ap_process_float_batch(self->engine, self->info.rate, channels, n_periods, self->planes);
+
+  if (err >= 0) {
+    for (p = 0; p < n_periods; p++)
+      gst_webrtc_interleave_s16 (self->planes + p * channels,
+          (gint16 *) map.data + p * samples, channels, self->period_samples);
+  } else
+    GST_WARNING_OBJECT (self, "Failed to process audio: %s.",
+        ap_error (self->engine, err));
+
+  gst_buffer_unmap (buffer, &map);
+
+  /* The src segment is in running time, as for the other aggregators */
+  duration = n_periods * PERIOD_DURATION;
+  GST_BUFFER_PTS (buffer) = self->capture_time;
+  GST_BUFFER_DURATION (buffer) = duration;
+
+  if (GST_CLOCK_TIME_IS_VALID (self->capture_time)) {
+    self->capture_time += duration;
+    GST_AGGREGATOR_PAD (agg->srcpad)->segment.position = self->capture_time;
+  }
+
+  if (self->discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    self->discont = FALSE;
+  }
+
+  return gst_aggregator_finish_buffer (agg, buffer);
+}
+
+static GstFlowReturn
+gst_webrtc_echo_canceller_aggregate (GstAggregator * agg, gboolean timeout)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (agg);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstWebrtcReverseStatus status = REVERSE_NONE;
+  GstClockTime rt;
+  guint n, whole;
+
+  gst_webrtc_echo_canceller_gather (self, self->sinkpad, self->capture,
+      &self->capture_time);
+  gst_webrtc_echo_canceller_gather (self, self->reversepad, self->reverse,
+      &self->reverse_time);
+
+  if (!self->engine) {
+    if (gst_aggregator_pad_is_eos (self->sinkpad))
+      return GST_FLOW_EOS;
+    return GST_FLOW_OK;
+  }
+
+  if (g_atomic_int_get (&self->config_pending))
+    gst_webrtc_echo_canceller_apply_config (self);
+
+  whole = gst_adapter_available (self->capture) / self->period_size;
+
+  while (ret == GST_FLOW_OK && whole > 0) {
+    /* The far end of each period goes in first, then the batch of near
+     * end periods it covers */
+    for (n = 0; n < MIN (whole, MAX_BATCH_PERIODS); n++) {
+      rt = GST_CLOCK_TIME_IS_VALID (self->capture_time) ?
+          self->capture_time + n * PERIOD_DURATION : GST_CLOCK_TIME_NONE;
+
+      status = gst_webrtc_echo_canceller_feed_reverse (self, rt, timeout);
+      if (status == REVERSE_WAIT)
+        break;
+    }
+
+    if (n == 0)
+      break;
+
+    ret = gst_webrtc_echo_canceller_process (self, n);
+    whole -= n;
+
+    if (status == REVERSE_WAIT)
+      break;
+  }
+
+  if (ret == GST_FLOW_OK && gst_aggregator_pad_is_eos (self->sinkpad) &&
+      gst_adapter_available (self->capture) < self->period_size)
+    return GST_FLOW_EOS;
+
+  return ret;
+}
+
+static void
+gst_webrtc_echo_canceller_free_capture (GstWebrtcEchoCanceller * self)
+{
+  if (self->engine) {
+    ap_delete(self->engine);
+    self->engine = NULL;
+  }
+
+  g_free (self->scratch);
+  self->scratch = NULL;
+  g_free (self->planes);
+  self->planes = NULL;
+  self->period_size = 0;
+}
+
+static void
+gst_webrtc_echo_canceller_free_reverse (GstWebrtcEchoCanceller * self)
+{
+  g_free (self->reverse_scratch);
+  self->reverse_scratch = NULL;
+  g_free (self->reverse_planes);
+  self->reverse_planes = NULL;
+  self->reverse_period_size = 0;
+}
+
+static gboolean
+gst_webrtc_echo_canceller_setup_capture (GstWebrtcEchoCanceller * self,
+    const GstAudioInfo * info)
+{
+  guint c;
+
+  gst_webrtc_echo_canceller_free_capture (self);
+
+  self->info = *info;
+  self->period_samples = info->rate / 100;
+  self->period_size = self->period_samples * info->bpf;
+
+  self->scratch = g_new (float,
+      MAX_BATCH_PERIODS * info->channels * self->period_samples);
+  self->planes = g_new (float *, MAX_BATCH_PERIODS * info->channels);
+  for (c = 0; c < MAX_BATCH_PERIODS * (guint) info->channels; c++)
+    self->planes[c] = self->scratch + c * self->period_samples;
+
+  GST_OBJECT_LOCK (self);
+  self->engine = ap_setup(PROCESSING_RATE, self->echo_cancel, self->noise_suppression, self->noise_suppression_level, self->gain_controller, LS_NONE);
+  if (self->engine)
+    ap_delay(self->engine, self->delay);
+  g_atomic_int_set (&self->config_pending, FALSE);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!self->engine) {
+    GST_ELEMENT_ERROR (self, LIBRARY, INIT,
+        ("Could not create the audio processing engine."), (NULL));
+    return FALSE;
+  }
+
+  gst_adapter_clear (self->capture);
+  self->discont = TRUE;
+
+  return TRUE;
+}
+
+static void
+gst_webrtc_echo_canceller_setup_reverse (GstWebrtcEchoCanceller * self,
+    const GstAudioInfo * info)
+{
+  guint c;
+
+  gst_webrtc_echo_canceller_free_reverse (self);
+
+  self->reverse_info = *info;
+  self->reverse_period_samples = info->rate / 100;
+  self->reverse_period_size = self->reverse_period_samples * info->bpf;
+
+  self->reverse_scratch = g_new (float, info->channels * self->reverse_period_samples);
+  self->reverse_planes = g_new (float *, info->channels);
+  for (c = 0; c < (guint) info->channels; c++)
+    self->reverse_planes[c] = self->reverse_scratch + c * self->reverse_period_samples;
+
+  gst_adapter_clear (self->reverse);
+}
+
+static gboolean
+gst_webrtc_echo_canceller_sink_event (GstAggregator * agg,
+    GstAggregatorPad * pad, GstEvent * event)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (agg);
+  GstAudioInfo info;
+  GstCaps *caps;
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    gst_event_parse_caps (event, &caps);
+
+    if (!gst_audio_info_from_caps (&info, caps)) {
+      gst_event_unref (event);
+      return FALSE;
+    }
+
+    if (pad == self->sinkpad) {
+      if (!gst_webrtc_echo_canceller_setup_capture (self, &info)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+      gst_pad_mark_reconfigure (agg->srcpad);
+    } else
+      gst_webrtc_echo_canceller_setup_reverse (self, &info);
+  }
+
+  return GST_AGGREGATOR_CLASS (gst_webrtc_echo_canceller_parent_class)->sink_event (agg, pad, event);
+}
+
+/* The output has the format of the near end */
+static GstFlowReturn
+gst_webrtc_echo_canceller_update_src_caps (GstAggregator * agg,
+    GstCaps * caps, GstCaps ** ret)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (agg);
+  GstCaps *capture_caps;
+
+  capture_caps = gst_pad_get_current_caps (GST_PAD (self->sinkpad));
+  if (!capture_caps)
+    return GST_AGGREGATOR_FLOW_NEED_DATA;
+
+  *ret = gst_caps_intersect (caps, capture_caps);
+  gst_caps_unref (capture_caps);
+
+  if (gst_caps_is_empty (*ret)) {
+    gst_caps_unref (*ret);
+    *ret = NULL;
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_webrtc_echo_canceller_flush (GstAggregator * agg)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (agg);
+
+  gst_adapter_clear (self->capture);
+  gst_adapter_clear (self->reverse);
+  self->capture_time = GST_CLOCK_TIME_NONE;
+  self->reverse_time = GST_CLOCK_TIME_NONE;
+  self->discont = TRUE;
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_webrtc_echo_canceller_start (GstAggregator * agg)
+{
+  gst_webrtc_echo_canceller_flush (agg);
+
+  /* Whole periods are output */
+  gst_aggregator_set_latency (agg, PERIOD_DURATION, PERIOD_DURATION);
+
+  return TRUE;
+}
+
+static gboolean
+gst_webrtc_echo_canceller_stop (GstAggregator * agg)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (agg);
+
+  gst_webrtc_echo_canceller_flush (agg);
+  gst_webrtc_echo_canceller_free_capture (self);
+  gst_webrtc_echo_canceller_free_reverse (self);
+
+  return TRUE;
+}
+
+static void
+gst_webrtc_echo_canceller_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_ECHO_CANCEL:
+      self->echo_cancel = g_value_get_boolean (value);
+      break;
+    case PROP_NOISE_SUPPRESSION:
+      self->noise_suppression = g_value_get_boolean (value);
+      break;
+    case PROP_NOISE_SUPPRESSION_LEVEL:
+      self->noise_suppression_level =
+          (GstWebrtcAudioProcessingNoiseSuppressionLevel) g_value_get_enum (value);
+      break;
+    case PROP_GAIN_CONTROLLER:
+      self->gain_controller = g_value_get_boolean (value);
+      break;
+    case PROP_DELAY:
+      self->delay = g_value_get_int (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  g_atomic_int_set (&self->config_pending, TRUE);
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_webrtc_echo_canceller_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_ECHO_CANCEL:
+      g_value_set_boolean (value, self->echo_cancel);
+      break;
+    case PROP_NOISE_SUPPRESSION:
+      g_value_set_boolean (value, self->noise_suppression);
+      break;
+    case PROP_NOISE_SUPPRESSION_LEVEL:
+      g_value_set_enum (value, self->noise_suppression_level);
+      break;
+    case PROP_GAIN_CONTROLLER:
+      g_value_set_boolean (value, self->gain_controller);
+      break;
+    case PROP_DELAY:
+      g_value_set_int (value, self->delay);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_webrtc_echo_canceller_finalize (GObject * object)
+{
+  GstWebrtcEchoCanceller *self = GST_WEBRTC_ECHO_CANCELLER (object);
+
+  gst_object_unref (self->capture);
+  gst_object_unref (self->reverse);
+  gst_webrtc_echo_canceller_free_capture (self);
+  gst_webrtc_echo_canceller_free_reverse (self);
+
+  G_OBJECT_CLASS (gst_webrtc_echo_canceller_parent_class)->finalize (object);
+}
+
+static void
+gst_webrtc_echo_canceller_init (GstWebrtcEchoCanceller * self)
+{
+  GstElementClass *klass = GST_ELEMENT_GET_CLASS (self);
+
+  self->sinkpad = GST_AGGREGATOR_PAD (g_object_new (GST_TYPE_AGGREGATOR_PAD,
+          "name", "sink", "direction", GST_PAD_SINK, "template",
+          gst_element_class_get_pad_template (klass, "sink"), NULL));
+  gst_element_add_pad (GST_ELEMENT (self), GST_PAD (self->sinkpad));
+
+  self->reversepad = GST_AGGREGATOR_PAD (g_object_new (GST_TYPE_AGGREGATOR_PAD,
+          "name", "reverse", "direction", GST_PAD_SINK, "template",
+          gst_element_class_get_pad_template (klass, "reverse"), NULL));
+  gst_element_add_pad (GST_ELEMENT (self), GST_PAD (self->reversepad));
+
+  self->capture = gst_adapter_new ();
+  self->reverse = gst_adapter_new ();
+  self->capture_time = GST_CLOCK_TIME_NONE;
+  self->reverse_time = GST_CLOCK_TIME_NONE;
+  gst_audio_info_init (&self->info);
+  gst_audio_info_init (&self->reverse_info);
+}
+
+static void
+gst_webrtc_echo_canceller_class_init (GstWebrtcEchoCancellerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstAggregatorClass *agg_class = GST_AGGREGATOR_CLASS (klass);
+
+  gobject_class->finalize = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_finalize);
+  gobject_class->set_property = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_set_property);
+  gobject_class->get_property = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_get_property);
+
+  agg_class->aggregate = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_aggregate);
+  agg_class->sink_event = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_sink_event);
+  agg_class->update_src_caps =
+      GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_update_src_caps);
+  agg_class->flush = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_flush);
+  agg_class->start = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_start);
+  agg_class->stop = GST_DEBUG_FUNCPTR (gst_webrtc_echo_canceller_stop);
+  agg_class->get_next_time = gst_aggregator_simple_get_next_time;
+
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &gst_webrtc_echo_canceller_src_template, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &gst_webrtc_echo_canceller_sink_template, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &gst_webrtc_echo_canceller_reverse_template, GST_TYPE_AGGREGATOR_PAD);
+  gst_element_class_set_static_metadata (element_class,
+      "Echo canceller",
+      "Filter/Audio",
+      "Cancels the echo of a far end given on a second pad with WebRTC Audio Processing Library",
+      "Guillaume Cartier <gucartier@gmail.com>");
+
+  g_object_class_install_property (gobject_class,
+      PROP_ECHO_CANCEL,
+      g_param_spec_boolean ("echo-cancel", "Echo Cancel",
+          "Enable or disable echo canceller", DEFAULT_ECHO_CANCEL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_NOISE_SUPPRESSION,
+      g_param_spec_boolean ("noise-suppression", "Noise Suppression",
+          "Enable or disable noise suppression", DEFAULT_NOISE_SUPPRESSION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_NOISE_SUPPRESSION_LEVEL,
+      g_param_spec_enum ("noise-suppression-level", "Noise Suppression Level",
+          "Controls the aggressiveness of the suppression. Increasing the "
+          "level will reduce the noise level at the expense of a higher "
+          "speech distortion.", GST_TYPE_WEBRTC_NOISE_SUPPRESSION_LEVEL,
+          NSL_MODERATE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_GAIN_CONTROLLER,
+      g_param_spec_boolean ("gain-controller", "Gain Controller",
+          "Enable or disable the gain controller", DEFAULT_GAIN_CONTROLLER,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_DELAY,
+      g_param_spec_int ("delay", "Delay",
+          "Echo path delay in ms not covered by running time, from the "
+          "reverse pad to the loudspeaker and from the microphone to the "
+          "sink pad", 0, 1500, DEFAULT_DELAY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+}
@@ -0,0 +1,956 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/**
+ * SECTION:element-webrtcmultiprocessor
+ * @short_description: Processes many voice streams with one element
+ *
+ * Hosts any number of voice streams, each with its own processing engine,
+ * behind sink_\%u / src_\%u request pad pairs. Requesting sink_N creates
+ * src_N, which outputs the processed audio of sink_N. This replaces one
+ * webrtcaudioprocessor per participant in mixers and conference servers.
+ *
+ * Every stream's audio is processed on the worker pool shared by the
+ * whole process, in order for a stream and independently of the other
+ * streams, as soon as its input arrives. A task on each src pad pushes the
+ * stream's output, so a blocked downstream never holds a pool thread.
+ * Upstream threads only queue their buffers.
+ *
+ * The echo canceller of a stream is fed from the webrtcaudioprobe named by
+ * the #GstWebrtcMultiProcessorPad:probe property of its sink pad. Echo
+ * cancel, noise suppression and gain control are set for all streams on
+ * the element, and may be changed while playing.
+ *
+ * Streams are interleaved S16 at a rate the engine supports. For other
+ * formats or rates, use webrtcaudioprocessor.
+ *
+ * # Example launch line
+ *
+ * |[
+ * gst-launch-1.0 webrtcmultiprocessor name=p echo-cancel=false noise-suppression=true \
+ *   pulsesrc ! p.sink_0  p.src_0 ! fakesink \
+ *   audiotestsrc wave=pink-noise ! p.sink_1  p.src_1 ! fakesink
+ * ]|
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include "gst/webrtcaudioprocessing/gstwebrtcmultiprocessor.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcaudioprocessor.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcaudioprobe.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcconvert.h"
+#include "gst/webrtcaudioprocessing/gstwebrtcworkers.h"
+
+GST_DEBUG_CATEGORY_EXTERN (webrtc_audio_processor_debug);
+#define GST_CAT_DEFAULT (webrtc_audio_processor_debug)
+
+#define DEFAULT_ECHO_CANCEL FALSE
+#define DEFAULT_NOISE_SUPPRESSION FALSE
+#define DEFAULT_GAIN_CONTROLLER FALSE
+
+/* Periods handed to the engine per call */
+#define MAX_BATCH_PERIODS 10
+
+/* Inputs of a stream waiting for a worker, and outputs waiting for its src
+ * pad task, before its upstream blocks */
+#define MAX_JOBS 4
+#define MAX_OUTPUTS 8
+
+/* Every engine runs at the highest rate the streams may have */
+#define PROCESSING_RATE 48000
+
+static GstStaticPadTemplate gst_webrtc_multi_processor_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (S16) ", "
+        "layout = (string) interleaved, "
+        "rate = (int) { 48000, 32000, 16000, 8000 }, "
+        "channels = (int) [1, MAX]")
+    );
+
+static GstStaticPadTemplate gst_webrtc_multi_processor_src_template =
+GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (S16) ", "
+        "layout = (string) interleaved, "
+        "rate = (int) { 48000, 32000, 16000, 8000 }, "
+        "channels = (int) [1, MAX]")
+    );
+
+enum
+{
+  PROP_0,
+  PROP_ECHO_CANCEL,
+  PROP_NOISE_SUPPRESSION,
+  PROP_NOISE_SUPPRESSION_LEVEL,
+  PROP_GAIN_CONTROLLER,
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_PROBE,
+};
+
+/* One sink/src pad pair and its engine */
+struct _GstWebrtcMultiStream
+{
+  GstWebrtcMultiProcessor *self;
+  GstPad *sinkpad;
+  GstPad *srcpad;
+
+  /* Set up by the sink pad's streaming thread on caps, with the worker
+   * drained, then only used by the stream's jobs */
+  GstAudioInfo info;
+  guint period_samples;
+  guint period_size;
+  GstSegment segment;
+  GstAdapter *adapter;
+  gboolean discont;
+  ap_engine *engine;
+  GstWebrtcAudioProbe *probe;
+
+  /* One float plane per channel and period of a batch */
+  float *scratch;
+  float **planes;
+
+  /* Inputs waiting for a worker, and the first flow error the worker met
+   * or FLUSHING during a flush, returned to upstream on its next buffer */
+  GstWebrtcWorkerQueue *worker;
+  gint flow;
+
+  /* Processed buffers waiting for the src pad task, out_busy being set
+   * while it pushes one */
+  GMutex out_lock;
+  GCond out_cond;
+  GQueue outputs;
+  gboolean out_flushing;
+  gboolean out_busy;
+
+  /* Set when a property changed, applied by the next job */
+  gint config_pending;
+};
+
+G_DEFINE_TYPE (GstWebrtcMultiProcessorPad, gst_webrtc_multi_processor_pad, GST_TYPE_PAD);
+
+G_DEFINE_TYPE (GstWebrtcMultiProcessor, gst_webrtc_multi_processor, GST_TYPE_ELEMENT);
+
+static void
+gst_webrtc_multi_processor_pad_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstWebrtcMultiProcessorPad *pad = GST_WEBRTC_MULTI_PROCESSOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+  switch (prop_id) {
+    case PROP_PAD_PROBE:
+      g_free (pad->probe_name);
+      pad->probe_name = g_value_dup_string (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+gst_webrtc_multi_processor_pad_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstWebrtcMultiProcessorPad *pad = GST_WEBRTC_MULTI_PROCESSOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+  switch (prop_id) {
+    case PROP_PAD_PROBE:
+      g_value_set_string (value, pad->probe_name);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+gst_webrtc_multi_processor_pad_finalize (GObject * object)
+{
+  GstWebrtcMultiProcessorPad *pad = GST_WEBRTC_MULTI_PROCESSOR_PAD (object);
+
+  g_free (pad->probe_name);
+
+  G_OBJECT_CLASS (gst_webrtc_multi_processor_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_webrtc_multi_processor_pad_class_init (GstWebrtcMultiProcessorPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_webrtc_multi_processor_pad_finalize;
+  gobject_class->set_property = gst_webrtc_multi_processor_pad_set_property;
+  gobject_class->get_property = gst_webrtc_multi_processor_pad_get_property;
+
+  g_object_class_install_property (gobject_class,
+      PROP_PAD_PROBE,
+      g_param_spec_string ("probe", "Probe",
+          "The name of the webrtcaudioprobe carrying this stream's far end, "
+          "or NULL to process the stream without echo cancellation. Takes "
+          "effect on the next caps negotiation.", NULL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_webrtc_multi_processor_pad_init (GstWebrtcMultiProcessorPad * pad)
+{
+  (void) pad;
+}
+
+static GstWebrtcMultiStream *
+gst_webrtc_multi_processor_stream (GstPad * pad)
+{
+  return (GstWebrtcMultiStream *) gst_pad_get_element_private (pad);
+}
+
+/* Applies the element's processing properties to a running engine,
+ * keeping its convergence state */
+static void
+gst_webrtc_multi_processor_apply_config (GstWebrtcMultiStream * stream)
+{
+  GstWebrtcMultiProcessor *self = stream->self;
+  gboolean echo_cancel, noise_suppression, gain_controller;
+  int noise_suppression_level;
+
+  GST_OBJECT_LOCK (self);
+  echo_cancel = self->echo_cancel;
+  noise_suppression = self->noise_suppression;
+  noise_suppression_level = self->noise_suppression_level;
+  gain_controller = self->gain_controller;
+  g_atomic_int_set (&stream->config_pending, FALSE);
+  GST_OBJECT_UNLOCK (self);
+
+  ap_configure(stream->engine, echo_cancel, noise_suppression, noise_suppression_level, gain_controller);
+}
+
+/* The clock time a period was captured at, comparable with the probe's
+ * frame stamps */
+static GstClockTime
+gst_webrtc_multi_processor_clock_time (GstWebrtcMultiStream * stream,
+    GstClockTime timestamp)
+{
+  GstClockTime running_time;
+
+  running_time = gst_segment_to_running_time (&stream->segment, GST_FORMAT_TIME,
+      timestamp);
+
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return GST_CLOCK_TIME_NONE;
+
+  return running_time + gst_element_get_base_time (GST_ELEMENT (stream->self));
+}
+
+static void
+gst_webrtc_multi_processor_queue_output (GstWebrtcMultiStream * stream,
+    GstBuffer * buffer)
+{
+  g_mutex_lock (&stream->out_lock);
+  if (stream->out_flushing) {
+    gst_buffer_unref (buffer);
+  } else {
+    g_queue_push_tail (&stream->outputs, buffer);
+    g_cond_broadcast (&stream->out_cond);
+  }
+  g_mutex_unlock (&stream->out_lock);
+}
+
+static void
+gst_webrtc_multi_processor_clear_outputs (GstWebrtcMultiStream * stream)
+{
+  GstBuffer *buffer;
+
+  g_mutex_lock (&stream->out_lock);
+  while ((buffer = (GstBuffer *) g_queue_pop_head (&stream->outputs)))
+    gst_buffer_unref (buffer);
+  g_cond_broadcast (&stream->out_cond);
+  g_mutex_unlock (&stream->out_lock);
+}
+
+static void
+gst_webrtc_multi_processor_set_out_flushing (GstWebrtcMultiStream * stream,
+    gboolean flushing)
+{
+  g_mutex_lock (&stream->out_lock);
+  stream->out_flushing = flushing;
+  g_cond_broadcast (&stream->out_cond);
+  g_mutex_unlock (&stream->out_lock);
+}
+
+/* Processes the next n_periods of the adapter as one engine call, and
+ * queues them for the stream's src pad task. Returns FALSE when they could
+ * not be mapped. */
+static gboolean
+gst_webrtc_multi_processor_process (GstWebrtcMultiStream * stream,
+    guint n_periods)
+{
+  guint channels = stream->info.channels;
+  guint samples = stream->period_samples * channels;
+  GstClockTime pts, ts;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  guint64 distance;
+  guint p;
+  gint err;
+
+  pts = gst_adapter_prev_pts (stream->adapter, &distance);
+  ts = GST_CLOCK_TIME_IS_VALID (pts) ? pts + gst_util_uint64_scale_int (
+      distance / stream->info.bpf, GST_SECOND, stream->info.rate) :
+      GST_CLOCK_TIME_NONE;
+
+  buffer = gst_adapter_take_buffer (stream->adapter,
+      n_periods * stream->period_size);
+  buffer = gst_buffer_make_writable (buffer);
+
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READWRITE)) {
+    gst_buffer_unref (buffer);
+    return FALSE;
+  }
+
+  if (g_atomic_int_get (&stream->config_pending))
+    gst_webrtc_multi_processor_apply_config (stream);
+
+  if (stream->probe)
+    gst_webrtc_audio_probe_process_reverse (stream->probe,
+        gst_webrtc_multi_processor_clock_time (stream, ts),
+        stream->info.rate, n_periods);
+
+  for (p = 0; p < n_periods; p++)
+    gst_webrtc_deinterleave_s16 ((const gint16 *) map.data + p * samples,
+        stream->planes + p * channels, channels, stream->period_samples);
+
+  err = ap_process_float_batch(stream->engine, stream->info.rate, channels, n_periods, stream->planes);
+
+  if (err >= 0) {
+    for (p = 0; p < n_periods; p++)
+      gst_webrtc_interleave_s16 (stream->planes + p * channels,
+          (gint16 *) map.data + p * samples, channels, stream->period_samples);
+  } else
+    GST_WARNING_OBJECT (stream->sinkpad, "Failed to process audio: %s.",
+        ap_error (stream->engine, err));
+
+  gst_buffer_unmap (buffer, &map);
+
+  GST_BUFFER_PTS (buffer) = ts;
+  GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale_int (
+      n_periods * stream->period_samples, GST_SECOND, stream->info.rate);
+
+  if (stream->discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    stream->discont = FALSE;
+  }
+
+  gst_webrtc_multi_processor_queue_output (stream, buffer);
+
+  return TRUE;
+}
+
+/* Runs on a pool thread, one input of a stream at a time */
+static void
+gst_webrtc_multi_processor_run (gpointer data, gpointer user_data)
+{
+  GstWebrtcMultiStream *stream = (GstWebrtcMultiStream *) user_data;
+  GstBuffer *buffer = GST_BUFFER_CAST (data);
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint n;
+
+  if (g_atomic_int_get (&stream->flow) != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+
+  if (GST_BUFFER_IS_DISCONT (buffer)) {
+    gst_adapter_clear (stream->adapter);
+    stream->discont = TRUE;
+  }
+
+  gst_adapter_push (stream->adapter, buffer);
+
+  while (ret == GST_FLOW_OK) {
+    n = MIN (gst_adapter_available (stream->adapter) / stream->period_size,
+        MAX_BATCH_PERIODS);
+    if (n == 0)
+      break;
+
+    if (!gst_webrtc_multi_processor_process (stream, n))
+      ret = GST_FLOW_ERROR;
+  }
+
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (stream->sinkpad, "Worker stopped: %s",
+        gst_flow_get_name (ret));
+    g_atomic_int_compare_and_exchange (&stream->flow, GST_FLOW_OK, ret);
+  }
+}
+
+/* The src pad task, pushes what the stream's jobs produced */
+static void
+gst_webrtc_multi_processor_push_loop (gpointer user_data)
+{
+  GstWebrtcMultiStream *stream = (GstWebrtcMultiStream *) user_data;
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&stream->out_lock);
+  while (!stream->out_flushing && g_queue_is_empty (&stream->outputs))
+    g_cond_wait (&stream->out_cond, &stream->out_lock);
+
+  if (stream->out_flushing) {
+    g_mutex_unlock (&stream->out_lock);
+    gst_pad_pause_task (stream->srcpad);
+    return;
+  }
+
+  buffer = (GstBuffer *) g_queue_pop_head (&stream->outputs);
+  stream->out_busy = TRUE;
+  g_mutex_unlock (&stream->out_lock);
+
+  ret = gst_pad_push (stream->srcpad, buffer);
+
+  /* Returned to upstream on its next buffer, the following outputs still
+   * being taken so that nobody waits on them */
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (stream->srcpad, "Push failed: %s",
+        gst_flow_get_name (ret));
+    g_atomic_int_compare_and_exchange (&stream->flow, GST_FLOW_OK, ret);
+  }
+
+  g_mutex_lock (&stream->out_lock);
+  stream->out_busy = FALSE;
+  g_cond_broadcast (&stream->out_cond);
+  g_mutex_unlock (&stream->out_lock);
+}
+
+/* Waits until everything queued so far was processed and pushed */
+static void
+gst_webrtc_multi_processor_drain (GstWebrtcMultiStream * stream)
+{
+  gst_webrtc_worker_queue_drain (stream->worker);
+
+  g_mutex_lock (&stream->out_lock);
+  while (!stream->out_flushing &&
+      (stream->out_busy || !g_queue_is_empty (&stream->outputs)))
+    g_cond_wait (&stream->out_cond, &stream->out_lock);
+  g_mutex_unlock (&stream->out_lock);
+}
+
+static gboolean
+gst_webrtc_multi_processor_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active)
+{
+  GstWebrtcMultiStream *stream = gst_webrtc_multi_processor_stream (pad);
+
+  (void) parent;
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return FALSE;
+
+  if (active) {
+    gst_webrtc_multi_processor_set_out_flushing (stream, FALSE);
+    return gst_pad_start_task (pad, gst_webrtc_multi_processor_push_loop,
+        stream, NULL);
+  }
+
+  gst_webrtc_multi_processor_set_out_flushing (stream, TRUE);
+  return gst_pad_stop_task (pad);
+}
+
+/* Releases the probe and deletes the engine. The worker must be idle. */
+static void
+gst_webrtc_multi_processor_teardown (GstWebrtcMultiStream * stream)
+{
+  if (stream->probe) {
+    gst_webrtc_audio_probe_release (stream->probe);
+    stream->probe = NULL;
+  }
+
+  if (stream->engine) {
+    ap_delete(stream->engine);
+    stream->engine = NULL;
+  }
+
+  g_free (stream->scratch);
+  stream->scratch = NULL;
+  g_free (stream->planes);
+  stream->planes = NULL;
+
+  gst_adapter_clear (stream->adapter);
+  stream->discont = TRUE;
+}
+
+static gboolean
+gst_webrtc_multi_processor_setup (GstWebrtcMultiStream * stream, GstCaps * caps)
+{
+  GstWebrtcMultiProcessor *self = stream->self;
+  GstAudioInfo info;
+  gchar *probe_name;
+  guint c;
+
+  if (!gst_audio_info_from_caps (&info, caps))
+    return FALSE;
+
+  gst_webrtc_multi_processor_teardown (stream);
+
+  stream->info = info;
+  stream->period_samples = info.rate / 100;
+  stream->period_size = stream->period_samples * info.bpf;
+
+  stream->scratch = g_new (float,
+      MAX_BATCH_PERIODS * info.channels * stream->period_samples);
+  stream->planes = g_new (float *, MAX_BATCH_PERIODS * info.channels);
+  for (c = 0; c < MAX_BATCH_PERIODS * (guint) info.channels; c++)
+    stream->planes[c] = stream->scratch + c * stream->period_samples;
+
+  GST_OBJECT_LOCK (stream->sinkpad);
+  probe_name = g_strdup (GST_WEBRTC_MULTI_PROCESSOR_PAD (stream->sinkpad)->probe_name);
+  GST_OBJECT_UNLOCK (stream->sinkpad);
+
+  GST_OBJECT_LOCK (self);
+  stream->engine = ap_setup(PROCESSING_RATE, self->echo_cancel, self->noise_suppression, self->noise_suppression_level, self->gain_controller, LS_NONE);
+  g_atomic_int_set (&stream->config_pending, FALSE);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!stream->engine) {
+    GST_ELEMENT_ERROR (self, LIBRARY, INIT,
+        ("Could not create the audio processing engine."), (NULL));
+    g_free (probe_name);
+    return FALSE;
+  }
+
+  if (probe_name) {
+    stream->probe = gst_webrtc_audio_probe_acquire (probe_name,
+        GST_ELEMENT (self), stream->engine);
+
+    if (!stream->probe) {
+      GST_ELEMENT_ERROR (self, RESOURCE, NOT_FOUND,
+          ("No free webrtcaudioprobe named '%s' found.", probe_name), (NULL));
+      g_free (probe_name);
+      return FALSE;
+    }
+  }
+
+  GST_DEBUG_OBJECT (stream->sinkpad, "Processing %d Hz, %d channels%s%s",
+      info.rate, info.channels, probe_name ? ", far end from " : "",
+      probe_name ? probe_name : "");
+
+  g_free (probe_name);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_webrtc_multi_processor_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstWebrtcMultiStream *stream = gst_webrtc_multi_processor_stream (pad);
+  GstFlowReturn ret;
+
+  (void) parent;
+
+  ret = (GstFlowReturn) g_atomic_int_get (&stream->flow);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  if (!stream->engine) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  /* Downstream sets the pace, through the src pad task */
+  g_mutex_lock (&stream->out_lock);
+  while (!stream->out_flushing &&
+      g_queue_get_length (&stream->outputs) >= MAX_OUTPUTS &&
+      g_atomic_int_get (&stream->flow) == GST_FLOW_OK)
+    g_cond_wait (&stream->out_cond, &stream->out_lock);
+  g_mutex_unlock (&stream->out_lock);
+
+  if (!gst_webrtc_worker_queue_push (stream->worker, buffer)) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_FLUSHING;
+  }
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_webrtc_multi_processor_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstWebrtcMultiStream *stream = gst_webrtc_multi_processor_stream (pad);
+  GstCaps *caps;
+  gboolean res;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      /* Forwarded first, to unblock a push of the src pad task */
+      res = gst_pad_event_default (pad, parent, event);
+      gst_webrtc_worker_queue_set_flushing (stream->worker, TRUE);
+      g_atomic_int_set (&stream->flow, GST_FLOW_FLUSHING);
+      gst_webrtc_multi_processor_set_out_flushing (stream, TRUE);
+      gst_pad_pause_task (stream->srcpad);
+      return res;
+    case GST_EVENT_FLUSH_STOP:
+      gst_webrtc_worker_queue_drain (stream->worker);
+      gst_webrtc_worker_queue_set_flushing (stream->worker, FALSE);
+      gst_webrtc_multi_processor_clear_outputs (stream);
+      gst_webrtc_multi_processor_set_out_flushing (stream, FALSE);
+      gst_adapter_clear (stream->adapter);
+      stream->discont = TRUE;
+      gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+      g_atomic_int_set (&stream->flow, GST_FLOW_OK);
+      res = gst_pad_event_default (pad, parent, event);
+      gst_pad_start_task (stream->srcpad, gst_webrtc_multi_processor_push_loop,
+          stream, NULL);
+      return res;
+    default:
+      /* Serialized events stay behind the buffers queued before them */
+      if (GST_EVENT_IS_SERIALIZED (event))
+        gst_webrtc_multi_processor_drain (stream);
+      break;
+  }
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+      gst_event_parse_caps (event, &caps);
+      if (!gst_webrtc_multi_processor_setup (stream, caps)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+      break;
+    case GST_EVENT_SEGMENT:
+      gst_event_copy_segment (event, &stream->segment);
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static GstIterator *
+gst_webrtc_multi_processor_iterate_internal_links (GstPad * pad,
+    GstObject * parent)
+{
+  GstWebrtcMultiStream *stream = gst_webrtc_multi_processor_stream (pad);
+  GValue value = G_VALUE_INIT;
+  GstIterator *it;
+
+  (void) parent;
+
+  g_value_init (&value, GST_TYPE_PAD);
+  g_value_set_object (&value,
+      pad == stream->sinkpad ? stream->srcpad : stream->sinkpad);
+  it = gst_iterator_new_single (GST_TYPE_PAD, &value);
+  g_value_unset (&value);
+
+  return it;
+}
+
+static GstPad *
+gst_webrtc_multi_processor_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstWebrtcMultiProcessor *self = GST_WEBRTC_MULTI_PROCESSOR (element);
+  GstWebrtcMultiStream *stream;
+  gchar *sink_name, *src_name;
+  GstPad *existing;
+  guint index;
+
+  (void) caps;
+
+  GST_OBJECT_LOCK (self);
+  if (!name || sscanf (name, "sink_%u", &index) != 1)
+    index = self->next_index;
+  self->next_index = MAX (self->next_index, index + 1);
+  GST_OBJECT_UNLOCK (self);
+
+  sink_name = g_strdup_printf ("sink_%u", index);
+  src_name = g_strdup_printf ("src_%u", index);
+
+  existing = gst_element_get_static_pad (element, sink_name);
+  if (existing) {
+    GST_WARNING_OBJECT (self, "Pad %s already exists", sink_name);
+    gst_object_unref (existing);
+    g_free (sink_name);
+    g_free (src_name);
+    return NULL;
+  }
+
+  stream = g_new0 (GstWebrtcMultiStream, 1);
+  stream->self = self;
+  stream->adapter = gst_adapter_new ();
+  stream->discont = TRUE;
+  gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+  stream->worker = gst_webrtc_worker_queue_new (gst_webrtc_multi_processor_run,
+      stream, (GDestroyNotify) gst_mini_object_unref, MAX_JOBS);
+  g_mutex_init (&stream->out_lock);
+  g_cond_init (&stream->out_cond);
+  g_queue_init (&stream->outputs);
+  stream->out_flushing = TRUE;
+
+  stream->sinkpad = GST_PAD (g_object_new (GST_TYPE_WEBRTC_MULTI_PROCESSOR_PAD,
+          "name", sink_name, "direction", GST_PAD_SINK, "template", templ,
+          NULL));
+  stream->srcpad = gst_pad_new_from_static_template (
+      &gst_webrtc_multi_processor_src_template, src_name);
+  g_free (sink_name);
+  g_free (src_name);
+
+  gst_pad_set_element_private (stream->sinkpad, stream);
+  gst_pad_set_element_private (stream->srcpad, stream);
+
+  gst_pad_set_chain_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_chain));
+  gst_pad_set_event_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_sink_event));
+  gst_pad_set_iterate_internal_links_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_iterate_internal_links));
+  gst_pad_set_iterate_internal_links_function (stream->srcpad,
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_iterate_internal_links));
+  gst_pad_set_activatemode_function (stream->srcpad,
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_src_activate_mode));
+  GST_PAD_SET_PROXY_CAPS (stream->sinkpad);
+  GST_PAD_SET_PROXY_CAPS (stream->srcpad);
+
+  GST_OBJECT_LOCK (self);
+  self->streams = g_list_append (self->streams, stream);
+  GST_OBJECT_UNLOCK (self);
+
+  gst_element_add_pad (element, stream->srcpad);
+  gst_element_add_pad (element, stream->sinkpad);
+
+  return stream->sinkpad;
+}
+
+static void
+gst_webrtc_multi_processor_release_pad (GstElement * element, GstPad * pad)
+{
+  GstWebrtcMultiProcessor *self = GST_WEBRTC_MULTI_PROCESSOR (element);
+  GstWebrtcMultiStream *stream = gst_webrtc_multi_processor_stream (pad);
+
+  GST_OBJECT_LOCK (self);
+  self->streams = g_list_remove (self->streams, stream);
+  GST_OBJECT_UNLOCK (self);
+
+  /* Unblocks upstream and stops the src pad task before the pads go */
+  gst_webrtc_worker_queue_set_flushing (stream->worker, TRUE);
+  gst_pad_set_active (stream->srcpad, FALSE);
+  gst_webrtc_worker_queue_drain (stream->worker);
+  gst_webrtc_multi_processor_clear_outputs (stream);
+
+  gst_element_remove_pad (element, stream->srcpad);
+  gst_element_remove_pad (element, stream->sinkpad);
+
+  gst_webrtc_multi_processor_teardown (stream);
+  gst_webrtc_worker_queue_free (stream->worker);
+  gst_object_unref (stream->adapter);
+  g_mutex_clear (&stream->out_lock);
+  g_cond_clear (&stream->out_cond);
+  g_free (stream);
+}
+
+static GstStateChangeReturn
+gst_webrtc_multi_processor_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstWebrtcMultiProcessor *self = GST_WEBRTC_MULTI_PROCESSOR (element);
+  GstStateChangeReturn ret;
+  GList *streams, *l;
+
+  ret = GST_ELEMENT_CLASS (gst_webrtc_multi_processor_parent_class)->change_state
+      (element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    /* The pads are inactive by now and their tasks stopped. Jobs take
+     * the object lock, it cannot be held while draining. */
+    GST_OBJECT_LOCK (self);
+    streams = g_list_copy (self->streams);
+    GST_OBJECT_UNLOCK (self);
+
+    for (l = streams; l; l = l->next) {
+      GstWebrtcMultiStream *stream = (GstWebrtcMultiStream *) l->data;
+
+      gst_webrtc_worker_queue_set_flushing (stream->worker, TRUE);
+      gst_webrtc_worker_queue_drain (stream->worker);
+      gst_webrtc_multi_processor_clear_outputs (stream);
+      gst_webrtc_multi_processor_teardown (stream);
+      gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+      gst_webrtc_worker_queue_set_flushing (stream->worker, FALSE);
+      g_atomic_int_set (&stream->flow, GST_FLOW_OK);
+    }
+
+    g_list_free (streams);
+  }
+
+  return ret;
+}
+
+/* Called with the object lock held */
+static void
+gst_webrtc_multi_processor_schedule_config (GstWebrtcMultiProcessor * self)
+{
+  GList *l;
+
+  for (l = self->streams; l; l = l->next)
+    g_atomic_int_set (&((GstWebrtcMultiStream *) l->data)->config_pending, TRUE);
+}
+
+static void
+gst_webrtc_multi_processor_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstWebrtcMultiProcessor *self = GST_WEBRTC_MULTI_PROCESSOR (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_ECHO_CANCEL:
+      self->echo_cancel = g_value_get_boolean (value);
+      break;
+    case PROP_NOISE_SUPPRESSION:
+      self->noise_suppression = g_value_get_boolean (value);
+      break;
+    case PROP_NOISE_SUPPRESSION_LEVEL:
+      self->noise_suppression_level =
+          (GstWebrtcAudioProcessingNoiseSuppressionLevel) g_value_get_enum (value);
+      break;
+    case PROP_GAIN_CONTROLLER:
+      self->gain_controller = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  gst_webrtc_multi_processor_schedule_config (self);
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_webrtc_multi_processor_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstWebrtcMultiProcessor *self = GST_WEBRTC_MULTI_PROCESSOR (object);
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_ECHO_CANCEL:
+      g_value_set_boolean (value, self->echo_cancel);
+      break;
+    case PROP_NOISE_SUPPRESSION:
+      g_value_set_boolean (value, self->noise_suppression);
+      break;
+    case PROP_NOISE_SUPPRESSION_LEVEL:
+      g_value_set_enum (value, self->noise_suppression_level);
+      break;
+    case PROP_GAIN_CONTROLLER:
+      g_value_set_boolean (value, self->gain_controller);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_webrtc_multi_processor_class_init (GstWebrtcMultiProcessorClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->set_property = GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_set_property);
+  gobject_class->get_property = GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_get_property);
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_release_pad);
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_webrtc_multi_processor_change_state);
+
+  gst_element_class_add_static_pad_template_with_gtype (element_class,
+      &gst_webrtc_multi_processor_sink_template,
+      GST_TYPE_WEBRTC_MULTI_PROCESSOR_PAD);
+  gst_element_class_add_static_pad_template (element_class,
+      &gst_webrtc_multi_processor_src_template);
+  gst_element_class_set_static_metadata (element_class,
+      "Multi-stream voice processor",
+      "Generic/Audio",
+      "Processes many voice streams with WebRTC Audio Processing Library",
+      "Guillaume Cartier <gucartier@gmail.com>");
+
+  g_object_class_install_property (gobject_class,
+      PROP_ECHO_CANCEL,
+      g_param_spec_boolean ("echo-cancel", "Echo Cancel",
+          "Enable or disable echo canceller", DEFAULT_ECHO_CANCEL,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_NOISE_SUPPRESSION,
+      g_param_spec_boolean ("noise-suppression", "Noise Suppression",
+          "Enable or disable noise suppression", DEFAULT_NOISE_SUPPRESSION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_NOISE_SUPPRESSION_LEVEL,
+      g_param_spec_enum ("noise-suppression-level", "Noise Suppression Level",
+          "Controls the aggressiveness of the suppression. Increasing the "
+          "level will reduce the noise level at the expense of a higher "
+          "speech distortion.", GST_TYPE_WEBRTC_NOISE_SUPPRESSION_LEVEL,
+          NSL_MODERATE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property (gobject_class,
+      PROP_GAIN_CONTROLLER,
+      g_param_spec_boolean ("gain-controller", "Gain Controller",
+          "Enable or disable the gain controller", DEFAULT_GAIN_CONTROLLER,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              G_PARAM_CONSTRUCT | GST_PARAM_MUTABLE_PLAYING)));
+
+  gst_type_mark_as_plugin_api (GST_TYPE_WEBRTC_MULTI_PROCESSOR_PAD, (GstPluginAPIFlags) 0);
+}
+
+static void
+gst_webrtc_multi_processor_init (GstWebrtcMultiProcessor * self)
+{
+  (void) self;
+}
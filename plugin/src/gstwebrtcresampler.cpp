@@ -0,0 +1,484 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Each output sample is the dot product of the taps input samples around
+ * its position with the filter for its fractional phase, interpolated
+ * linearly between the two nearest of PHASES precomputed phases. The
+ * filters are Blackman windowed sincs, cut off below the lower of the two
+ * Nyquist frequencies.
+ *
+ * Both dot products are computed in one pass by a kernel picked once for
+ * the running CPU, the same way as the conversion kernels.
+ *
+ * Banks only depend on the two rates, so they are computed once and shared
+ * by every resampler between the same rates, e.g. the capture and far end
+ * resamplers of all the sessions running at 44.1 kHz. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "gst/webrtcaudioprocessing/gstwebrtcresampler.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+/* Taps per filter when the output rate is not lower than the input rate.
+ * Downsampling stretches the filters by the ratio, so the transition band
+ * keeps the same width relative to the output rate. */
+#define TAPS 64
+#define PHASES 64
+
+/* Cutoff relative to the lower Nyquist frequency. The Blackman window
+ * spreads the transition over about 5.5/TAPS of the lower rate, so the
+ * stopband starts right about at that Nyquist frequency and nothing above
+ * it folds back. */
+#define CUTOFF 0.9
+
+static gdouble
+sinc (gdouble x)
+{
+  return x == 0 ? 1.0 : sin (G_PI * x) / (G_PI * x);
+}
+
+static gdouble
+blackman (gdouble x)
+{
+  if (x <= -1 || x >= 1)
+    return 0;
+
+  return 0.42 + 0.5 * cos (G_PI * x) + 0.08 * cos (2 * G_PI * x);
+}
+
+typedef struct
+{
+  guint in_rate;
+  guint out_rate;
+  guint refcount;
+  gfloat *taps;
+} GstWebrtcResamplerBank;
+
+/* Taps of the filters between two rates, a multiple of the widest vector */
+static guint
+gst_webrtc_resampler_taps (guint in_rate, guint out_rate)
+{
+  guint taps = TAPS;
+
+  if (in_rate > out_rate)
+    taps = (guint) (((guint64) TAPS * in_rate + out_rate - 1) / out_rate);
+
+  return (taps + 7) & ~7u;
+}
+
+G_LOCK_DEFINE_STATIC (banks);
+static GList *banks = NULL;
+
+static void
+gst_webrtc_resampler_make_bank (gfloat * bank, guint in_rate, guint out_rate)
+{
+  gdouble cutoff = CUTOFF * MIN (1.0, (gdouble) out_rate / in_rate);
+  guint taps = gst_webrtc_resampler_taps (in_rate, out_rate);
+  guint half = taps / 2;
+  guint p, k;
+
+  for (p = 0; p <= PHASES; p++) {
+    gfloat *row = bank + p * taps;
+    gdouble frac = (gdouble) p / PHASES;
+    gdouble sum = 0;
+
+    for (k = 0; k < taps; k++) {
+      /* Distance from the output position to this tap's input sample */
+      gdouble t = (gdouble) k - (half - 1) - frac;
+      gdouble h = cutoff * sinc (cutoff * t) * blackman (t / half);
+
+      row[k] = (gfloat) h;
+      sum += h;
+    }
+
+    /* Unity gain at DC for every phase */
+    for (k = 0; k < taps; k++)
+      row[k] = (gfloat) (row[k] / sum);
+  }
+}
+
+static const gfloat *
+gst_webrtc_resampler_ref_bank (guint in_rate, guint out_rate)
+{
+  GstWebrtcResamplerBank *bank = NULL;
+  GList *l;
+
+  G_LOCK (banks);
+
+  for (l = banks; l && !bank; l = l->next) {
+    GstWebrtcResamplerBank *b = (GstWebrtcResamplerBank *) l->data;
+
+    if (b->in_rate == in_rate && b->out_rate == out_rate)
+      bank = b;
+  }
+
+  if (!bank) {
+    bank = g_new (GstWebrtcResamplerBank, 1);
+    bank->in_rate = in_rate;
+    bank->out_rate = out_rate;
+    bank->refcount = 0;
+    bank->taps = g_new (gfloat,
+        (PHASES + 1) * gst_webrtc_resampler_taps (in_rate, out_rate));
+    gst_webrtc_resampler_make_bank (bank->taps, in_rate, out_rate);
+    banks = g_list_prepend (banks, bank);
+  }
+
+  bank->refcount++;
+
+  G_UNLOCK (banks);
+
+  return bank->taps;
+}
+
+static void
+gst_webrtc_resampler_unref_bank (const gfloat * taps)
+{
+  GList *l;
+
+  G_LOCK (banks);
+
+  for (l = banks; l; l = l->next) {
+    GstWebrtcResamplerBank *b = (GstWebrtcResamplerBank *) l->data;
+
+    if (b->taps == taps) {
+      if (--b->refcount == 0) {
+        banks = g_list_delete_link (banks, l);
+        g_free (b->taps);
+        g_free (b);
+      }
+      break;
+    }
+  }
+
+  G_UNLOCK (banks);
+}
+
+/* The output sample for input x, between filter row and the next one, of
+ * taps each */
+typedef gfloat (*GstWebrtcFilterFunc) (const gfloat * row, const gfloat * x,
+    gfloat w, guint taps);
+
+static gfloat
+filter_scalar (const gfloat * row, const gfloat * x, gfloat w, guint taps)
+{
+  gfloat a = 0, b = 0;
+  guint k;
+
+  for (k = 0; k < taps; k++) {
+    a += row[k] * x[k];
+    b += row[taps + k] * x[k];
+  }
+
+  return a + w * (b - a);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+__attribute__ ((target ("sse2")))
+static inline gfloat
+hsum_sse2 (__m128 v)
+{
+  v = _mm_add_ps (v, _mm_movehl_ps (v, v));
+  v = _mm_add_ss (v, _mm_shuffle_ps (v, v, 1));
+
+  return _mm_cvtss_f32 (v);
+}
+
+__attribute__ ((target ("sse2")))
+static gfloat
+filter_sse2 (const gfloat * row, const gfloat * x, gfloat w, guint taps)
+{
+  __m128 a = _mm_setzero_ps (), b = _mm_setzero_ps ();
+  guint k;
+
+  for (k = 0; k < taps; k += 4) {
+    __m128 v = _mm_loadu_ps (x + k);
+
+    a = _mm_add_ps (a, _mm_mul_ps (_mm_loadu_ps (row + k), v));
+    b = _mm_add_ps (b, _mm_mul_ps (_mm_loadu_ps (row + taps + k), v));
+  }
+
+  /* Interpolate once, on the vectors */
+  a = _mm_add_ps (a, _mm_mul_ps (_mm_set1_ps (w), _mm_sub_ps (b, a)));
+
+  return hsum_sse2 (a);
+}
+
+__attribute__ ((target ("avx2")))
+static gfloat
+filter_avx2 (const gfloat * row, const gfloat * x, gfloat w, guint taps)
+{
+  __m256 a = _mm256_setzero_ps (), b = _mm256_setzero_ps ();
+  __m128 s;
+  guint k;
+
+  for (k = 0; k < taps; k += 8) {
+    __m256 v = _mm256_loadu_ps (x + k);
+
+    a = _mm256_add_ps (a, _mm256_mul_ps (_mm256_loadu_ps (row + k), v));
+    b = _mm256_add_ps (b, _mm256_mul_ps (_mm256_loadu_ps (row + taps + k), v));
+  }
+
+  a = _mm256_add_ps (a, _mm256_mul_ps (_mm256_set1_ps (w), _mm256_sub_ps (b, a)));
+
+  s = _mm_add_ps (_mm256_castps256_ps128 (a), _mm256_extractf128_ps (a, 1));
+  s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+  s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 1));
+
+  return _mm_cvtss_f32 (s);
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+
+static gfloat
+filter_neon (const gfloat * row, const gfloat * x, gfloat w, guint taps)
+{
+  float32x4_t a = vdupq_n_f32 (0), b = vdupq_n_f32 (0);
+  guint k;
+
+  for (k = 0; k < taps; k += 4) {
+    float32x4_t v = vld1q_f32 (x + k);
+
+    a = vmlaq_f32 (a, vld1q_f32 (row + k), v);
+    b = vmlaq_f32 (b, vld1q_f32 (row + taps + k), v);
+  }
+
+  a = vmlaq_n_f32 (a, vsubq_f32 (b, a), w);
+
+  return vaddvq_f32 (a);
+}
+
+#endif /* HAVE_NEON_KERNELS */
+
+static GstWebrtcFilterFunc filter = filter_scalar;
+
+static void
+gst_webrtc_resampler_init (void)
+{
+  static gsize initialized = 0;
+
+  if (!g_once_init_enter (&initialized))
+    return;
+
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("sse2"))
+    filter = filter_sse2;
+  if (__builtin_cpu_supports ("avx2"))
+    filter = filter_avx2;
+#endif
+
+#ifdef HAVE_NEON_KERNELS
+  filter = filter_neon;
+#endif
+
+  g_once_init_leave (&initialized, 1);
+}
+
+/* max_pending is the most input its owner lets wait in the queue, beyond
+ * which the oldest is dropped */
+GstWebrtcResampler*
+gst_webrtc_resampler_new (guint channels, guint in_rate, guint out_rate,
+    guint max_pending)
+{
+  GstWebrtcResampler *self = g_new0 (GstWebrtcResampler, 1);
+  guint c;
+
+  gst_webrtc_resampler_init ();
+
+  self->channels = channels;
+  self->in_rate = in_rate;
+  self->out_rate = out_rate;
+  self->nominal = (gdouble) in_rate / out_rate;
+  self->ratio = self->nominal;
+
+  self->bank = gst_webrtc_resampler_ref_bank (in_rate, out_rate);
+  self->taps = gst_webrtc_resampler_taps (in_rate, out_rate);
+  self->half = self->taps / 2;
+
+  self->size = max_pending + self->taps;
+  self->queue = g_new (gfloat *, channels);
+  for (c = 0; c < channels; c++)
+    self->queue[c] = g_new (gfloat, self->size);
+
+  gst_webrtc_resampler_reset (self);
+
+  return self;
+}
+
+void
+gst_webrtc_resampler_free (GstWebrtcResampler * self)
+{
+  guint c;
+
+  if (!self)
+    return;
+
+  for (c = 0; c < self->channels; c++)
+    g_free (self->queue[c]);
+  g_free (self->queue);
+  gst_webrtc_resampler_unref_bank (self->bank);
+  g_free (self);
+}
+
+/* Drops queued input, keeping the ratio */
+void
+gst_webrtc_resampler_reset (GstWebrtcResampler * self)
+{
+  guint c;
+
+  for (c = 0; c < self->channels; c++)
+    memset (self->queue[c], 0, (self->half - 1) * sizeof (gfloat));
+
+  self->fill = self->half - 1;
+  self->position = self->half - 1;
+}
+
+/* Consumes input faster (drift > 0) or slower than nominal by a relative
+ * amount, e.g. 1e-4 for 100 ppm */
+void
+gst_webrtc_resampler_set_drift (GstWebrtcResampler * self, gdouble drift)
+{
+  self->ratio = self->nominal * (1.0 + drift);
+}
+
+/* Queues samples of input per channel. Returns FALSE when the queue
+ * overflowed and the oldest input was dropped to make room. */
+gboolean
+gst_webrtc_resampler_push (GstWebrtcResampler * self,
+    const float * const * in, guint samples)
+{
+  gboolean overflow = FALSE;
+  guint c;
+
+  if (samples > self->size - self->fill) {
+    guint drop = MIN (self->fill, samples - (self->size - self->fill));
+
+    for (c = 0; c < self->channels; c++)
+      memmove (self->queue[c], self->queue[c] + drop,
+          (self->fill - drop) * sizeof (gfloat));
+
+    self->fill -= drop;
+    self->position = MAX (self->position - drop, (gdouble) (self->half - 1));
+    samples = MIN (samples, self->size - self->fill);
+    overflow = TRUE;
+  }
+
+  for (c = 0; c < self->channels; c++)
+    memcpy (self->queue[c] + self->fill, in[c], samples * sizeof (gfloat));
+
+  self->fill += samples;
+
+  return !overflow;
+}
+
+/* Output samples the queued input is enough for */
+guint
+gst_webrtc_resampler_available (GstWebrtcResampler * self)
+{
+  gdouble last = (gdouble) self->fill - self->half - 1;
+
+  if (last < self->position)
+    return 0;
+
+  return (guint) ((last - self->position) / self->ratio) + 1;
+}
+
+/* Forgets the input no future output reaches back to */
+static void
+gst_webrtc_resampler_forget (GstWebrtcResampler * self)
+{
+  guint c, drop;
+
+  drop = (guint) self->position - (self->half - 1);
+  drop = MIN (drop, self->fill);
+
+  for (c = 0; c < self->channels; c++)
+    memmove (self->queue[c], self->queue[c] + drop,
+        (self->fill - drop) * sizeof (gfloat));
+
+  self->fill -= drop;
+  self->position -= drop;
+}
+
+/* Queued input not yet reached by the output, in input samples. Divided by
+ * the input rate, the time between the newest input and the next output. */
+gdouble
+gst_webrtc_resampler_pending (GstWebrtcResampler * self)
+{
+  return self->fill - self->position;
+}
+
+/* Produces samples of output per channel, no more than available */
+void
+gst_webrtc_resampler_pull (GstWebrtcResampler * self, float * const * out,
+    guint samples)
+{
+  gdouble position = self->position;
+  guint i, c;
+
+  g_return_if_fail (samples <= gst_webrtc_resampler_available (self));
+
+  for (i = 0; i < samples; i++) {
+    guint index = (guint) position;
+    gdouble phase = (position - index) * PHASES;
+    guint p = (guint) phase;
+    gfloat w = (gfloat) (phase - p);
+    const gfloat *row = self->bank + p * self->taps;
+
+    for (c = 0; c < self->channels; c++)
+      out[c][i] = filter (row, self->queue[c] + index - (self->half - 1), w,
+          self->taps);
+
+    position += self->ratio;
+  }
+
+  self->position = position;
+  gst_webrtc_resampler_forget (self);
+}
+
+/* Moves past the next samples of queued input, at most all of it, without
+ * producing output for them */
+void
+gst_webrtc_resampler_skip (GstWebrtcResampler * self, guint samples)
+{
+  self->position += MIN ((gdouble) samples,
+      gst_webrtc_resampler_pending (self));
+  gst_webrtc_resampler_forget (self);
+}
@@ -0,0 +1,131 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gst/webrtcaudioprocessing/gstwebrtcring.h"
+
+GstWebrtcRing*
+gst_webrtc_ring_new (guint frame_size, guint n_frames)
+{
+  GstWebrtcRing *ring = new GstWebrtcRing;
+  guint n = 1;
+
+  while (n < n_frames)
+    n <<= 1;
+
+  ring->frame_size = frame_size;
+  ring->n_frames = n;
+  ring->data = (guint8 *) g_malloc0 ((gsize) frame_size * n);
+  ring->stamps = g_new0 (guint64, n);
+  ring->head.store (0);
+  ring->tail.store (0);
+
+  return ring;
+}
+
+void
+gst_webrtc_ring_free (GstWebrtcRing * ring)
+{
+  if (!ring)
+    return;
+
+  g_free (ring->data);
+  g_free (ring->stamps);
+  delete ring;
+}
+
+/* Producer side: the frame to fill next, or NULL when the ring is full. The
+ * same frame is returned until it is published. */
+guint8*
+gst_webrtc_ring_write_frame (GstWebrtcRing * ring)
+{
+  guint head = ring->head.load (std::memory_order_relaxed);
+  guint tail = ring->tail.load (std::memory_order_acquire);
+
+  if (head - tail >= ring->n_frames)
+    return NULL;
+
+  return ring->data + (gsize) (head & (ring->n_frames - 1)) * ring->frame_size;
+}
+
+void
+gst_webrtc_ring_publish (GstWebrtcRing * ring, guint64 stamp)
+{
+  guint head = ring->head.load (std::memory_order_relaxed);
+
+  ring->stamps[head & (ring->n_frames - 1)] = stamp;
+  ring->head.store (head + 1, std::memory_order_release);
+}
+
+/* Consumer side: the oldest published frame, or NULL when the ring is
+ * empty. The frame stays valid, and may be modified, until consumed. */
+guint8*
+gst_webrtc_ring_read_frame (GstWebrtcRing * ring)
+{
+  guint tail = ring->tail.load (std::memory_order_relaxed);
+  guint head = ring->head.load (std::memory_order_acquire);
+
+  if (head == tail)
+    return NULL;
+
+  return ring->data + (gsize) (tail & (ring->n_frames - 1)) * ring->frame_size;
+}
+
+void
+gst_webrtc_ring_consume (GstWebrtcRing * ring)
+{
+  guint tail = ring->tail.load (std::memory_order_relaxed);
+
+  ring->tail.store (tail + 1, std::memory_order_release);
+}
+
+/* Consumer side: the stamp published with the frame index frames after
+ * the oldest, which must be published */
+guint64
+gst_webrtc_ring_peek_stamp (GstWebrtcRing * ring, guint index)
+{
+  guint tail = ring->tail.load (std::memory_order_relaxed);
+
+  return ring->stamps[(tail + index) & (ring->n_frames - 1)];
+}
+
+/* Number of published frames, exact for the consumer */
+guint
+gst_webrtc_ring_available (GstWebrtcRing * ring)
+{
+  guint tail = ring->tail.load (std::memory_order_relaxed);
+  guint head = ring->head.load (std::memory_order_acquire);
+
+  return head - tail;
+}
+
+/* Consumer side: drops every published frame */
+void
+gst_webrtc_ring_clear (GstWebrtcRing * ring)
+{
+  guint head = ring->head.load (std::memory_order_acquire);
+
+  ring->tail.store (head, std::memory_order_release);
+}
@@ -0,0 +1,185 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gst/webrtcaudioprocessing/gstwebrtcworkers.h"
+
+static void gst_webrtc_worker_queue_run (gpointer data, gpointer user_data);
+
+static gpointer
+gst_webrtc_workers_create (gpointer data)
+{
+  (void) data;
+
+  return g_thread_pool_new (gst_webrtc_worker_queue_run, NULL,
+      (gint) g_get_num_processors (), FALSE, NULL);
+}
+
+/* The pool lives as long as the process, its threads are only started
+ * when the first queue gets a job */
+static GThreadPool *
+gst_webrtc_workers_get (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  return (GThreadPool *) g_once (&once, gst_webrtc_workers_create, NULL);
+}
+
+/* Runs the next job of a queue, then puts the queue back at the end of the
+ * pool's list if more are waiting */
+static void
+gst_webrtc_worker_queue_run (gpointer data, gpointer user_data)
+{
+  GstWebrtcWorkerQueue *queue = (GstWebrtcWorkerQueue *) data;
+  gpointer job;
+
+  (void) user_data;
+
+  g_mutex_lock (&queue->lock);
+  job = g_queue_pop_head (&queue->jobs);
+  /* Room for a producer waiting on a full queue */
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+
+  if (job)
+    queue->func (job, queue->user_data);
+
+  g_mutex_lock (&queue->lock);
+  if (g_queue_is_empty (&queue->jobs)) {
+    queue->scheduled = FALSE;
+    g_cond_broadcast (&queue->cond);
+  } else
+    g_thread_pool_push (gst_webrtc_workers_get (), queue, NULL);
+  g_mutex_unlock (&queue->lock);
+}
+
+/**
+ * gst_webrtc_worker_queue_new:
+ * @func: called on a pool thread with each job and @user_data
+ * @user_data: passed to @func
+ * @destroy: frees a job dropped without running
+ * @max_jobs: number of waiting jobs above which pushing blocks
+ *
+ * Returns: a new empty #GstWebrtcWorkerQueue
+ */
+GstWebrtcWorkerQueue*
+gst_webrtc_worker_queue_new (GFunc func, gpointer user_data,
+    GDestroyNotify destroy, guint max_jobs)
+{
+  GstWebrtcWorkerQueue *queue = g_new0 (GstWebrtcWorkerQueue, 1);
+
+  queue->func = func;
+  queue->user_data = user_data;
+  queue->destroy = destroy;
+  queue->max_jobs = MAX (max_jobs, 1);
+
+  g_mutex_init (&queue->lock);
+  g_cond_init (&queue->cond);
+  g_queue_init (&queue->jobs);
+
+  return queue;
+}
+
+/* Drops the waiting jobs and waits for the running one */
+void
+gst_webrtc_worker_queue_free (GstWebrtcWorkerQueue * queue)
+{
+  if (!queue)
+    return;
+
+  gst_webrtc_worker_queue_set_flushing (queue, TRUE);
+  gst_webrtc_worker_queue_drain (queue);
+
+  g_mutex_clear (&queue->lock);
+  g_cond_clear (&queue->cond);
+  g_free (queue);
+}
+
+/**
+ * gst_webrtc_worker_queue_push:
+ *
+ * Queues a job behind the previous ones, waiting first while max_jobs are
+ * already queued.
+ *
+ * Returns: %FALSE when the queue is flushing, the job then still belongs
+ * to the caller
+ */
+gboolean
+gst_webrtc_worker_queue_push (GstWebrtcWorkerQueue * queue, gpointer job)
+{
+  g_mutex_lock (&queue->lock);
+
+  while (!queue->flushing && g_queue_get_length (&queue->jobs) >= queue->max_jobs)
+    g_cond_wait (&queue->cond, &queue->lock);
+
+  if (queue->flushing) {
+    g_mutex_unlock (&queue->lock);
+    return FALSE;
+  }
+
+  g_queue_push_tail (&queue->jobs, job);
+
+  if (!queue->scheduled) {
+    queue->scheduled = TRUE;
+    g_thread_pool_push (gst_webrtc_workers_get (), queue, NULL);
+  }
+
+  g_mutex_unlock (&queue->lock);
+
+  return TRUE;
+}
+
+/* Waits until every queued job has run */
+void
+gst_webrtc_worker_queue_drain (GstWebrtcWorkerQueue * queue)
+{
+  g_mutex_lock (&queue->lock);
+  while (queue->scheduled)
+    g_cond_wait (&queue->cond, &queue->lock);
+  g_mutex_unlock (&queue->lock);
+}
+
+/* While flushing, waiting jobs are dropped and pushes refused. Does not
+ * wait for the running job, which may be blocked downstream until the
+ * flush reaches there. */
+void
+gst_webrtc_worker_queue_set_flushing (GstWebrtcWorkerQueue * queue,
+    gboolean flushing)
+{
+  gpointer job;
+
+  g_mutex_lock (&queue->lock);
+
+  queue->flushing = flushing;
+
+  if (flushing) {
+    while ((job = g_queue_pop_head (&queue->jobs)))
+      if (queue->destroy)
+        queue->destroy (job);
+    g_cond_broadcast (&queue->cond);
+  }
+
+  g_mutex_unlock (&queue->lock);
+}
@@ -0,0 +1,202 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Checks that every S16/float conversion kernel the running CPU supports
+ * matches the scalar reference bit for bit: 1 to 8 channels, lengths
+ * covering the vector loops and their scalar tails, the S16 extremes,
+ * saturation, rounding ties, signed zeros, denormals, infinities and NaN. */
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gst/webrtcaudioprocessing/gstwebrtcconvert.h"
+
+#define MAX_CHANNELS 8
+
+/* Lengths around every vector width, in samples per channel */
+static const guint lengths[] = {
+  0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 441, 480, 481
+};
+
+static guint32 seed = 1;
+
+static guint32
+next_random (void)
+{
+  seed = seed * 1664525 + 1013904223;
+  return seed >> 8;
+}
+
+/* Interleaved S16 input: the extremes and around zero first, then random */
+static gint16
+s16_sample (guint index)
+{
+  static const gint16 special[] = { -32768, 32767, -32767, 0, -1, 1 };
+
+  if (index < G_N_ELEMENTS (special))
+    return special[index];
+
+  return (gint16) (next_random () & 0xffff);
+}
+
+/* Float input: cases where conversions are known to differ first, then
+ * random values slightly past full scale */
+static float
+float_sample (guint index)
+{
+  static const float special[] = {
+    1.0f, -1.0f, 0.0f, -0.0f,
+    /* Saturation, before and after rounding */
+    32767.0f / 32768.0f, 32767.5f / 32768.0f, -32768.5f / 32768.0f,
+    1.5f, -1.5f, 1e30f, -1e30f,
+    /* Ties, rounding to even either way */
+    0.5f / 32768.0f, 1.5f / 32768.0f, 2.5f / 32768.0f,
+    -0.5f / 32768.0f, -1.5f / 32768.0f, -2.5f / 32768.0f,
+    32766.5f / 32768.0f, -32767.5f / 32768.0f,
+    /* Denormals */
+    1e-40f, -1e-40f,
+    INFINITY, -INFINITY, NAN, -NAN,
+  };
+
+  if (index < G_N_ELEMENTS (special))
+    return special[index];
+
+  return ((gint32) (next_random () % 80000) - 40000) / 32768.0f;
+}
+
+static gboolean
+check_deinterleave (const GstWebrtcConvertKernel * ref,
+    const GstWebrtcConvertKernel * kernel, guint channels, guint samples)
+{
+  std::vector<gint16> src (channels * samples);
+  std::vector<float> expected (channels * samples), actual (channels * samples);
+  float *expected_planes[MAX_CHANNELS], *actual_planes[MAX_CHANNELS];
+  guint i, c;
+
+  for (i = 0; i < channels * samples; i++)
+    src[i] = s16_sample (i);
+
+  for (c = 0; c < channels; c++) {
+    expected_planes[c] = expected.data () + c * samples;
+    actual_planes[c] = actual.data () + c * samples;
+  }
+
+  ref->deinterleave (src.data (), expected_planes, channels, samples);
+  kernel->deinterleave (src.data (), actual_planes, channels, samples);
+
+  for (c = 0; c < channels; c++) {
+    for (i = 0; i < samples; i++) {
+      if (memcmp (&expected_planes[c][i], &actual_planes[c][i], sizeof (float))) {
+        g_printerr ("%s deinterleave, %u channels, %u samples: channel %u "
+            "sample %u is %a, expected %a\n", kernel->name, channels, samples,
+            c, i, actual_planes[c][i], expected_planes[c][i]);
+        return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+check_interleave (const GstWebrtcConvertKernel * ref,
+    const GstWebrtcConvertKernel * kernel, guint channels, guint samples)
+{
+  std::vector<float> src (channels * samples);
+  std::vector<gint16> expected (channels * samples), actual (channels * samples);
+  const float *planes[MAX_CHANNELS];
+  guint i, c;
+
+  /* Special values land on every channel and vector lane */
+  for (c = 0; c < channels; c++) {
+    planes[c] = src.data () + c * samples;
+
+    for (i = 0; i < samples; i++)
+      src[c * samples + i] = float_sample ((i + c) % (samples + 1));
+  }
+
+  ref->interleave (planes, expected.data (), channels, samples);
+  kernel->interleave (planes, actual.data (), channels, samples);
+
+  for (i = 0; i < channels * samples; i++) {
+    if (expected[i] != actual[i]) {
+      g_printerr ("%s interleave, %u channels, %u samples: channel %u "
+          "sample %u (%a) is %d, expected %d\n", kernel->name, channels,
+          samples, i % channels, i / channels,
+          planes[i % channels][i / channels], actual[i], expected[i]);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* The reference itself: NaN maps to 0 and full scale saturates */
+static gboolean
+check_reference (const GstWebrtcConvertKernel * ref)
+{
+  const float src[] = { NAN, -NAN, INFINITY, -INFINITY, 1.0f, -1.0f,
+    0.5f / 32768.0f, 1.5f / 32768.0f };
+  const gint16 expected[] = { 0, 0, 32767, -32768, 32767, -32768, 0, 2 };
+  const float *planes[] = { src };
+  gint16 dst[G_N_ELEMENTS (src)];
+  guint i;
+
+  ref->interleave (planes, dst, 1, G_N_ELEMENTS (src));
+
+  for (i = 0; i < G_N_ELEMENTS (src); i++) {
+    if (dst[i] != expected[i]) {
+      g_printerr ("scalar interleave: %a is %d, expected %d\n", src[i],
+          dst[i], expected[i]);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+int
+main (void)
+{
+  const GstWebrtcConvertKernel *kernels;
+  guint n_kernels, k, c, l;
+  gboolean ok;
+
+  kernels = gst_webrtc_convert_kernels (&n_kernels);
+
+  ok = check_reference (&kernels[0]);
+
+  for (k = 0; k < n_kernels; k++) {
+    g_print ("Checking %s\n", kernels[k].name);
+
+    for (c = 1; c <= MAX_CHANNELS; c++) {
+      for (l = 0; l < G_N_ELEMENTS (lengths); l++) {
+        ok &= check_deinterleave (&kernels[0], &kernels[k], c, lengths[l]);
+        ok &= check_interleave (&kernels[0], &kernels[k], c, lengths[l]);
+      }
+    }
+  }
+
+  return ok ? 0 : 1;
+}
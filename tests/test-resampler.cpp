@@ -0,0 +1,153 @@
+/*
+ * WebRTC Audio Processing Elements
+ *
+ *  Copyright 2020
+ *    @author: Guillaume Cartier <gucartier@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Measures the resampler on pure tones, fed in 10ms periods the way the
+ * probe and the processor do: the passband ripple up to PASSBAND of the
+ * lower Nyquist frequency, the distortion of passband tones, and the
+ * rejection of whatever would fold back from above the lower Nyquist
+ * frequency, aliases when downsampling and images when upsampling. */
+
+#include <math.h>
+
+#include <vector>
+
+#include "gst/webrtcaudioprocessing/gstwebrtcresampler.h"
+
+/* Band checked, relative to the lower Nyquist frequency, and tone step */
+#define PASSBAND 0.8
+#define STEP 0.02
+
+#define MAX_RIPPLE_DB 0.05
+#define MIN_REJECTION_DB 70.0
+
+#define AMPLITUDE 0.5
+
+/* Amplitude of the output tone at freq, and of everything else, relative
+ * to the input tone. Above the output Nyquist frequency there is no tone
+ * to keep and all of the output counts as leakage. */
+static void
+measure (guint in_rate, guint out_rate, gdouble freq, gdouble * gain,
+    gdouble * leakage)
+{
+  GstWebrtcResampler *resampler;
+  guint period = in_rate / 100;
+  std::vector<float> in (in_rate / 2), out;
+  gdouble cc = 0, ss = 0, cs = 0, yc = 0, ys = 0, a = 0, b = 0, det, err = 0;
+  guint i, first, last;
+
+  resampler = gst_webrtc_resampler_new (1, in_rate, out_rate, 2 * period);
+
+  for (i = 0; i < in.size (); i++)
+    in[i] = (float) (AMPLITUDE * sin (2 * G_PI * freq * i / in_rate));
+
+  for (i = 0; i + period <= in.size (); i += period) {
+    const float *src = &in[i];
+    float *dst;
+    guint n;
+
+    gst_webrtc_resampler_push (resampler, &src, period);
+    n = gst_webrtc_resampler_available (resampler);
+    out.resize (out.size () + n);
+    dst = &out[out.size () - n];
+    gst_webrtc_resampler_pull (resampler, &dst, n);
+  }
+
+  gst_webrtc_resampler_free (resampler);
+
+  /* Least squares fit of the tone, leaving the edges out */
+  first = out_rate / 20;
+  last = out.size () - out_rate / 20;
+
+  for (i = first; i < last; i++) {
+    gdouble c = cos (2 * G_PI * freq * i / out_rate);
+    gdouble s = sin (2 * G_PI * freq * i / out_rate);
+
+    cc += c * c;
+    ss += s * s;
+    cs += c * s;
+    yc += out[i] * c;
+    ys += out[i] * s;
+  }
+
+  if (freq < out_rate / 2.0) {
+    det = cc * ss - cs * cs;
+    a = (yc * ss - ys * cs) / det;
+    b = (ys * cc - yc * cs) / det;
+  }
+
+  for (i = first; i < last; i++) {
+    gdouble d = out[i] - a * cos (2 * G_PI * freq * i / out_rate) -
+        b * sin (2 * G_PI * freq * i / out_rate);
+
+    err += d * d;
+  }
+
+  *gain = sqrt (a * a + b * b) / AMPLITUDE;
+  *leakage = sqrt (2 * err / (last - first)) / AMPLITUDE;
+}
+
+static gboolean
+check_rates (guint in_rate, guint out_rate)
+{
+  gdouble nyquist = MIN (in_rate, out_rate) / 2.0;
+  gdouble top = (in_rate / 2.0) / nyquist;
+  gdouble x, gain, leakage, db;
+  gboolean ok = TRUE;
+
+  for (x = STEP; x < top - STEP / 2; x += STEP) {
+    measure (in_rate, out_rate, x * nyquist, &gain, &leakage);
+
+    if (x <= PASSBAND) {
+      db = 20 * log10 (gain);
+      if (fabs (db) > MAX_RIPPLE_DB) {
+        g_printerr ("%u -> %u Hz: %.0f Hz passes at %+.3f dB\n", in_rate,
+            out_rate, x * nyquist, db);
+        ok = FALSE;
+      }
+    }
+
+    /* Between the passband and the lower Nyquist frequency the tone is
+     * partly kept, partly folded back, and only the fold must be small */
+    db = -20 * log10 (leakage);
+    if (db < MIN_REJECTION_DB) {
+      g_printerr ("%u -> %u Hz: %.0f Hz leaks at -%.1f dB\n", in_rate,
+          out_rate, x * nyquist, db);
+      ok = FALSE;
+    }
+  }
+
+  return ok;
+}
+
+int
+main (void)
+{
+  gboolean ok = TRUE;
+
+  /* The far end of a wideband call to a 16 kHz engine, and a 44.1 kHz
+   * device to the 48 kHz engine */
+  ok &= check_rates (48000, 16000);
+  ok &= check_rates (44100, 48000);
+  ok &= check_rates (16000, 48000);
+
+  return ok ? 0 : 1;
+}